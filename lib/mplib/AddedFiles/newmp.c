@@ -84,9 +84,10 @@ double static setParameters(MP mp, mp_edge_object* hh) {
 
 	hh->xleftanchor = hh->yleftanchor = hh->xrightanchor = hh->yrightanchor = NAN;
 
-	hh->charname = mp_get_string_internal(mp, "charname")->str;
+	// copied since the edge can outlive the MetaPost strings (e.g. in the edges index)
+	hh->charname = mp_xstrdup(mp, (char*)mp_get_string_internal(mp, "charname")->str);
 
-	hh->originalglyph = mp_get_string_internal(mp, "originalglyph")->str;
+	hh->originalglyph = mp_xstrdup(mp, (char*)mp_get_string_internal(mp, "originalglyph")->str);
 
 	hh->numAnchors = mp_get_numeric_internal(mp, "number_of_anchors");
 
@@ -207,42 +208,514 @@ void mp_gr_toss_objects_extended(mp_edge_object* hh) {
 	for (int i = 0; i < hh->numAnchors; i++) {
 		mp_xfree(hh->anchors[i].anchorName);
 	}
+	mp_xfree(hh->charname);
+	mp_xfree(hh->originalglyph);
 	mp_gr_toss_objects(hh);
 }
+
+/*
+	Open addressing tables indexing run->edges by charcode and by charname.
+	The tables are rebuilt from the list when they grow.
+*/
+#define EDGE_INDEX_DELETED ((mp_edge_object*)1)
+
+typedef struct mp_edge_index {
+	size_t capacity;
+	size_t used;
+	mp_edge_object** bycode;
+	mp_edge_object** byname;
+} mp_edge_index;
+
+static size_t mp_edge_code_hash(int charcode) {
+	return (size_t)((unsigned int)charcode * 2654435761u);
+}
+static size_t mp_edge_name_hash(const char* charname) {
+	size_t hash = 2166136261u;
+	while (*charname) {
+		hash = (hash ^ (unsigned char)*charname++) * 16777619u;
+	}
+	return hash;
+}
+static mp_edge_object** mp_edge_code_slot(mp_edge_index* index, int charcode) {
+	size_t mask = index->capacity - 1;
+	size_t i = mp_edge_code_hash(charcode) & mask;
+	mp_edge_object** deleted = NULL;
+	while (index->bycode[i] != NULL) {
+		if (index->bycode[i] == EDGE_INDEX_DELETED) {
+			if (deleted == NULL) deleted = &index->bycode[i];
+		}
+		else if (index->bycode[i]->charcode == charcode) {
+			return &index->bycode[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return deleted != NULL ? deleted : &index->bycode[i];
+}
+static mp_edge_object** mp_edge_name_slot(mp_edge_index* index, const char* charname) {
+	size_t mask = index->capacity - 1;
+	size_t i = mp_edge_name_hash(charname) & mask;
+	mp_edge_object** deleted = NULL;
+	while (index->byname[i] != NULL) {
+		if (index->byname[i] == EDGE_INDEX_DELETED) {
+			if (deleted == NULL) deleted = &index->byname[i];
+		}
+		else if (strcmp(index->byname[i]->charname, charname) == 0) {
+			return &index->byname[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return deleted != NULL ? deleted : &index->byname[i];
+}
+static void mp_edge_index_add(mp_edge_index* index, mp_edge_object* hh) {
+	mp_edge_object** slot = mp_edge_code_slot(index, hh->charcode);
+	if (*slot == NULL) index->used++;
+	if (*slot == NULL || *slot == EDGE_INDEX_DELETED) *slot = hh;
+	if (hh->charname != NULL) {
+		// the first edge shipped with a charname wins as with a list walk, the others are chained after it
+		slot = mp_edge_name_slot(index, hh->charname);
+		hh->next_same_name = NULL;
+		if (*slot == NULL || *slot == EDGE_INDEX_DELETED) {
+			if (*slot == NULL) index->used++;
+			*slot = hh;
+			hh->prev_same_name = hh;
+		}
+		else {
+			mp_edge_object* first = *slot;
+			mp_edge_object* last = first->prev_same_name;
+			last->next_same_name = hh;
+			hh->prev_same_name = last;
+			first->prev_same_name = hh;
+		}
+	}
+}
+static void mp_edge_index_rebuild(MP mp, size_t capacity) {
+	mp_run_data* run = mp_rundata(mp);
+	mp_edge_index* index = run->edges_index;
+	if (index == NULL) {
+		index = mp_xmalloc(mp, 1, sizeof(mp_edge_index));
+		index->bycode = index->byname = NULL;
+		run->edges_index = index;
+	}
+	mp_xfree(index->bycode);
+	mp_xfree(index->byname);
+	index->capacity = capacity;
+	index->used = 0;
+	index->bycode = mp_xmalloc(mp, capacity, sizeof(mp_edge_object*));
+	index->byname = mp_xmalloc(mp, capacity, sizeof(mp_edge_object*));
+	memset(index->bycode, 0, capacity * sizeof(mp_edge_object*));
+	memset(index->byname, 0, capacity * sizeof(mp_edge_object*));
+	for (mp_edge_object* p = run->edges; p != NULL; p = p->next) {
+		mp_edge_index_add(index, p);
+	}
+}
+static mp_edge_index* mp_get_edge_index(MP mp) {
+	mp_run_data* run = mp_rundata(mp);
+	mp_edge_index* index = run->edges_index;
+	if (index == NULL || 2 * (index->used + 2) > index->capacity) {
+		size_t capacity = index == NULL ? 1024 : index->capacity;
+		size_t count = 0;
+		for (mp_edge_object* p = run->edges; p != NULL; p = p->next) {
+			count++;
+		}
+		while (4 * (count + 2) > capacity) {
+			capacity *= 2;
+		}
+		mp_edge_index_rebuild(mp, capacity);
+		index = run->edges_index;
+	}
+	return index;
+}
+static void mp_edge_index_remove(MP mp, mp_edge_object* hh) {
+	mp_edge_index* index = mp_rundata(mp)->edges_index;
+	if (index == NULL) return;
+	mp_edge_object** slot = mp_edge_code_slot(index, hh->charcode);
+	if (*slot == hh) *slot = EDGE_INDEX_DELETED;
+	if (hh->charname != NULL) {
+		slot = mp_edge_name_slot(index, hh->charname);
+		if (*slot == NULL || *slot == EDGE_INDEX_DELETED) return;
+		mp_edge_object* first = *slot;
+		mp_edge_object* next = hh->next_same_name;
+		if (first == hh) {
+			// the next edge with the same charname becomes the first one
+			*slot = next != NULL ? next : EDGE_INDEX_DELETED;
+			if (next != NULL) {
+				next->prev_same_name = hh->prev_same_name;
+			}
+		}
+		else {
+			hh->prev_same_name->next_same_name = next;
+			if (next != NULL) {
+				next->prev_same_name = hh->prev_same_name;
+			}
+			else {
+				first->prev_same_name = hh->prev_same_name;
+			}
+		}
+		hh->next_same_name = hh->prev_same_name = NULL;
+	}
+}
+mp_edge_object* mp_find_edge_by_code(MP mp, int charcode) {
+	mp_edge_object* edge = *mp_edge_code_slot(mp_get_edge_index(mp), charcode);
+	return edge == EDGE_INDEX_DELETED ? NULL : edge;
+}
+mp_edge_object* mp_find_edge_by_name(MP mp, const char* charname) {
+	mp_edge_object* edge = *mp_edge_name_slot(mp_get_edge_index(mp), charname);
+	return edge == EDGE_INDEX_DELETED ? NULL : edge;
+}
+void mp_detach_edge(MP mp, mp_edge_object* hh) {
+	mp_run_data* run = mp_rundata(mp);
+	mp_edge_index_remove(mp, hh);
+	if (hh->prev != NULL) {
+		hh->prev->next = hh->next;
+	}
+	else {
+		run->edges = hh->next;
+	}
+	if (hh->next != NULL) {
+		hh->next->prev = hh->prev;
+	}
+	else {
+		run->edges_tail = hh->prev;
+	}
+	hh->next = hh->prev = NULL;
+}
+void mp_free_edge(MP mp, mp_edge_object* hh) {
+	mp_detach_edge(mp, hh);
+	mp_gr_toss_objects_extended(hh);
+}
+void mp_free_edge_index(MP mp) {
+	mp_run_data* run = mp_rundata(mp);
+	if (run->edges_index != NULL) {
+		mp_xfree(run->edges_index->bycode);
+		mp_xfree(run->edges_index->byname);
+		mp_xfree(run->edges_index);
+		run->edges_index = NULL;
+	}
+}
+/*
+	File of the shipped edges of an instance, read back into another instance of the same font sources.
+	Only fill objects are kept, this is what the glyphs are made of. This is not a mem dump : the macros and the
+	symbol table are not saved, so the sources must still be run before the instance executes any statement.
+*/
+#define EDGES_FILE_MAGIC 0x444B4D45
+#define EDGES_FILE_VERSION 1
+
+typedef struct mp_edges_writer {
+	MP mp;
+	char* data;
+	size_t used;
+	size_t capacity;
+} mp_edges_writer;
+
+typedef struct mp_edges_reader {
+	const char* data;
+	size_t used;
+	size_t capacity;
+	int failed;
+} mp_edges_reader;
+
+static void mp_edges_file_write(mp_edges_writer* w, const void* src, size_t len) {
+	if (w->used + len > w->capacity) {
+		size_t capacity = w->capacity == 0 ? 65536 : w->capacity;
+		while (w->used + len > capacity) {
+			capacity *= 2;
+		}
+		char* data = mp_xmalloc(w->mp, capacity, 1);
+		if (w->used > 0) memcpy(data, w->data, w->used);
+		mp_xfree(w->data);
+		w->data = data;
+		w->capacity = capacity;
+	}
+	memcpy(w->data + w->used, src, len);
+	w->used += len;
+}
+static void mp_edges_file_write_int(mp_edges_writer* w, int value) {
+	mp_edges_file_write(w, &value, sizeof(int));
+}
+static void mp_edges_file_write_string(mp_edges_writer* w, const char* str) {
+	int len = str == NULL ? -1 : (int)strlen(str);
+	mp_edges_file_write_int(w, len);
+	if (len > 0) mp_edges_file_write(w, str, (size_t)len);
+}
+static void mp_edges_file_read(mp_edges_reader* r, void* dest, size_t len) {
+	if (r->failed || r->used + len > r->capacity) {
+		r->failed = 1;
+		memset(dest, 0, len);
+		return;
+	}
+	memcpy(dest, r->data + r->used, len);
+	r->used += len;
+}
+static int mp_edges_file_read_int(mp_edges_reader* r) {
+	int value;
+	mp_edges_file_read(r, &value, sizeof(int));
+	return value;
+}
+static char* mp_edges_file_read_string(MP mp, mp_edges_reader* r) {
+	int len = mp_edges_file_read_int(r);
+	if (r->failed || len < 0) return NULL;
+	if (r->used + (size_t)len > r->capacity) {
+		r->failed = 1;
+		return NULL;
+	}
+	char* str = mp_xmalloc(mp, (size_t)len + 1, 1);
+	memcpy(str, r->data + r->used, (size_t)len);
+	str[len] = 0;
+	r->used += (size_t)len;
+	return str;
+}
+static void mp_edges_file_write_edge(mp_edges_writer* w, mp_edge_object* hh) {
+	double metrics[17] = { hh->minx, hh->miny, hh->maxx, hh->maxy, hh->width, hh->height, hh->depth, hh->ital_corr,
+		hh->lefttatweel, hh->xleftanchor, hh->yleftanchor, hh->xrightanchor, hh->yrightanchor,
+		hh->charlt, hh->charrt, hh->xpart, hh->ypart };
+	mp_edges_file_write(w, metrics, sizeof(metrics));
+	mp_edges_file_write_int(w, hh->charcode);
+	mp_edges_file_write_string(w, hh->charname);
+	mp_edges_file_write_string(w, hh->originalglyph);
+	mp_edges_file_write_int(w, hh->numAnchors);
+	for (int i = 0; i < hh->numAnchors; i++) {
+		mp_edges_file_write_string(w, hh->anchors[i].anchorName);
+		mp_edges_file_write_int(w, hh->anchors[i].type);
+		mp_edges_file_write_int(w, hh->anchors[i].x);
+		mp_edges_file_write_int(w, hh->anchors[i].y);
+	}
+	int fills = 0;
+	for (mp_graphic_object* p = hh->body; p != NULL; p = p->next) {
+		if (p->type == mp_fill_code) fills++;
+	}
+	mp_edges_file_write_int(w, fills);
+	for (mp_graphic_object* p = hh->body; p != NULL; p = p->next) {
+		if (p->type != mp_fill_code) continue;
+		mp_fill_object* fill = (mp_fill_object*)p;
+		mp_edges_file_write(w, &fill->color, sizeof(mp_color));
+		mp_edges_file_write(w, &fill->color_model, 1);
+		mp_edges_file_write(w, &fill->ljoin, 1);
+		mp_edges_file_write(w, &fill->miterlim, sizeof(double));
+		int knots = 0;
+		mp_gr_knot k = fill->path_p;
+		if (k != NULL) {
+			do {
+				knots++;
+				k = k->next;
+			} while (k != fill->path_p);
+		}
+		mp_edges_file_write_int(w, knots);
+		for (int i = 0; i < knots; i++, k = k->next) {
+			double coords[6] = { k->x_coord, k->y_coord, k->left_x, k->left_y, k->right_x, k->right_y };
+			mp_edges_file_write(w, coords, sizeof(coords));
+			mp_edges_file_write(w, &k->data.types, sizeof(k->data.types));
+			mp_edges_file_write(w, &k->originator, 1);
+		}
+	}
+}
+static mp_edge_object* mp_edges_file_read_edge(MP mp, mp_edges_reader* r) {
+	mp_edge_object* hh = mp_xmalloc(mp, 1, sizeof(mp_edge_object));
+	memset(hh, 0, sizeof(mp_edge_object));
+	hh->parent = mp;
+	double metrics[17];
+	mp_edges_file_read(r, metrics, sizeof(metrics));
+	hh->minx = metrics[0]; hh->miny = metrics[1]; hh->maxx = metrics[2]; hh->maxy = metrics[3];
+	hh->width = metrics[4]; hh->height = metrics[5]; hh->depth = metrics[6]; hh->ital_corr = metrics[7];
+	hh->lefttatweel = metrics[8];
+	hh->xleftanchor = metrics[9]; hh->yleftanchor = metrics[10]; hh->xrightanchor = metrics[11]; hh->yrightanchor = metrics[12];
+	hh->charlt = metrics[13]; hh->charrt = metrics[14]; hh->xpart = metrics[15]; hh->ypart = metrics[16];
+	hh->charcode = mp_edges_file_read_int(r);
+	hh->charname = mp_edges_file_read_string(mp, r);
+	hh->originalglyph = mp_edges_file_read_string(mp, r);
+	int numAnchors = mp_edges_file_read_int(r);
+	if (numAnchors < 0 || numAnchors > 10) {
+		r->failed = 1;
+		numAnchors = 0;
+	}
+	for (int i = 0; i < numAnchors; i++) {
+		hh->anchors[i].anchorName = mp_edges_file_read_string(mp, r);
+		hh->anchors[i].type = mp_edges_file_read_int(r);
+		hh->anchors[i].x = mp_edges_file_read_int(r);
+		hh->anchors[i].y = mp_edges_file_read_int(r);
+		hh->numAnchors = i + 1;
+	}
+	int fills = mp_edges_file_read_int(r);
+	mp_graphic_object* last = NULL;
+	for (int i = 0; i < fills && !r->failed; i++) {
+		mp_fill_object* fill = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+		mp_edges_file_read(r, &fill->color, sizeof(mp_color));
+		mp_edges_file_read(r, &fill->color_model, 1);
+		mp_edges_file_read(r, &fill->ljoin, 1);
+		mp_edges_file_read(r, &fill->miterlim, sizeof(double));
+		if (last == NULL) {
+			hh->body = (mp_graphic_object*)fill;
+		}
+		else {
+			last->next = (mp_graphic_object*)fill;
+		}
+		last = (mp_graphic_object*)fill;
+		int knots = mp_edges_file_read_int(r);
+		mp_gr_knot current = NULL;
+		for (int j = 0; j < knots && !r->failed; j++) {
+			mp_gr_knot k = mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+			memset(k, 0, sizeof(struct mp_gr_knot_data));
+			double coords[6];
+			mp_edges_file_read(r, coords, sizeof(coords));
+			k->x_coord = coords[0]; k->y_coord = coords[1];
+			k->left_x = coords[2]; k->left_y = coords[3];
+			k->right_x = coords[4]; k->right_y = coords[5];
+			mp_edges_file_read(r, &k->data.types, sizeof(k->data.types));
+			mp_edges_file_read(r, &k->originator, 1);
+			if (current == NULL) {
+				fill->path_p = k;
+			}
+			else {
+				current->next = k;
+			}
+			current = k;
+		}
+		if (current != NULL) {
+			current->next = fill->path_p;
+		}
+	}
+	return hh;
+}
+int mp_save_shipped_edges(MP mp, const char* fname, const char* key, size_t keylen) {
+	mp_edges_writer w = { mp, NULL, 0, 0 };
+	int count = 0;
+	for (mp_edge_object* p = mp_rundata(mp)->edges; p != NULL; p = p->next) {
+		count++;
+	}
+	mp_edges_file_write_int(&w, EDGES_FILE_MAGIC);
+	mp_edges_file_write_int(&w, EDGES_FILE_VERSION);
+	mp_edges_file_write_int(&w, (int)keylen);
+	if (keylen > 0) mp_edges_file_write(&w, key, keylen);
+	mp_edges_file_write_int(&w, count);
+	for (mp_edge_object* p = mp_rundata(mp)->edges; p != NULL; p = p->next) {
+		mp_edges_file_write_edge(&w, p);
+	}
+	FILE* f = fopen(fname, "wb");
+	int ok = f != NULL && fwrite(w.data, 1, w.used, f) == w.used;
+	if (f != NULL) fclose(f);
+	mp_xfree(w.data);
+	return ok;
+}
+int mp_load_shipped_edges(MP mp, const char* fname, const char* key, size_t keylen) {
+	FILE* f = fopen(fname, "rb");
+	if (f == NULL) return 0;
+	fseek(f, 0, SEEK_END);
+	long fileSize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (fileSize <= 0) {
+		fclose(f);
+		return 0;
+	}
+	char* data = mp_xmalloc(mp, (size_t)fileSize, 1);
+	size_t read = fread(data, 1, (size_t)fileSize, f);
+	fclose(f);
+	mp_edges_reader r = { data, 0, read, read != (size_t)fileSize };
+	if (mp_edges_file_read_int(&r) != EDGES_FILE_MAGIC || mp_edges_file_read_int(&r) != EDGES_FILE_VERSION
+		|| mp_edges_file_read_int(&r) != (int)keylen || r.used + keylen > r.capacity
+		|| (keylen > 0 && memcmp(r.data + r.used, key, keylen) != 0)) {
+		mp_xfree(data);
+		return 0;
+	}
+	r.used += keylen;
+	int count = mp_edges_file_read_int(&r);
+	mp_edge_object* first = NULL;
+	mp_edge_object* last = NULL;
+	for (int i = 0; i < count && !r.failed; i++) {
+		mp_edge_object* hh = mp_edges_file_read_edge(mp, &r);
+		hh->prev = last;
+		if (last == NULL) {
+			first = hh;
+		}
+		else {
+			last->next = hh;
+		}
+		last = hh;
+	}
+	mp_xfree(data);
+	if (r.failed) {
+		while (first != NULL) {
+			mp_edge_object* next = first->next;
+			mp_gr_toss_objects_extended(first);
+			first = next;
+		}
+		return 0;
+	}
+	mp_run_data* run = mp_rundata(mp);
+	if (first != NULL) {
+		first->prev = run->edges_tail;
+		if (run->edges_tail != NULL) {
+			run->edges_tail->next = first;
+		}
+		else {
+			run->edges = first;
+		}
+		run->edges_tail = last;
+	}
+	mp_free_edge_index(mp);
+	return 1;
+}
+void mp_set_deferred_input(MP mp, const char* input) {
+	mp_run_data* run = mp_rundata(mp);
+	mp_xfree(run->deferred_input);
+	run->deferred_input = input != NULL ? mp_xstrdup(mp, input) : NULL;
+}
+int mp_has_deferred_input(MP mp) {
+	return mp_rundata(mp)->deferred_input != NULL;
+}
+int mp_run_deferred_input(MP mp) {
+	mp_run_data* run = mp_rundata(mp);
+	char* input = run->deferred_input;
+	if (input == NULL) return mp->history;
+	run->deferred_input = NULL;
+	run->keep_shipped_edges = 1;
+	int status = mp_execute(mp, input, strlen(input));
+	run->keep_shipped_edges = 0;
+	mp_xfree(input);
+	return status;
+}
 void mymplib_shipout_backend(MP mp, void* voidh) {
 	mp_edge_header_node h = (mp_edge_header_node)voidh;
 	mp_edge_object* hh = mp_gr_export(mp, h);
 	if (hh) {
 		setParameters(mp, hh);
 		mp_run_data* run = mp_rundata(mp);
-		if (run->edges == NULL) {
-			run->edges = hh;
+		mp_edge_index* index = mp_get_edge_index(mp);
+		mp_edge_object* p = *mp_edge_code_slot(index, hh->charcode);
+		if (p != NULL && p != EDGE_INDEX_DELETED && run->keep_shipped_edges) {
+			// loaded from an edges file, the existing edge may be referenced
+			mp_gr_toss_objects_extended(hh);
+			return;
+		}
+		if (p != NULL && p != EDGE_INDEX_DELETED) {
+			// replace the edge with the same charcode in place
+			mp_edge_index_remove(mp, p);
+			hh->prev = p->prev;
+			hh->next = p->next;
+			if (p->prev != NULL) {
+				p->prev->next = hh;
+			}
+			else {
+				run->edges = hh;
+			}
+			if (p->next != NULL) {
+				p->next->prev = hh;
+			}
+			else {
+				run->edges_tail = hh;
+			}
+			mp_gr_toss_objects_extended(p);
 		}
 		else {
-			mp_edge_object* p = run->edges;
-			mp_edge_object* prev = NULL;
-			bool exist = false;
-			do {
-				if (p->charcode == hh->charcode) {
-					if (prev) {
-						prev->next = hh;
-					}
-					else {
-						run->edges = hh;
-					}
-					hh->next = p->next;
-					mp_gr_toss_objects_extended(p);
-					exist = true;
-					break;
-				}
-				prev = p;
-				p = p->next;
-			} while (p);
-
-			if (!exist) {
-				prev->next = hh;
+			hh->next = NULL;
+			hh->prev = run->edges_tail;
+			if (run->edges_tail != NULL) {
+				run->edges_tail->next = hh;
+			}
+			else {
+				run->edges = hh;
 			}
+			run->edges_tail = hh;
 		}
+		mp_edge_index_add(index, hh);
 	}
 }
 void setAnchors(MP mp, mp_edge_object* hh) {
@@ -365,6 +838,166 @@ void getPointParam(MP mp, int index,double*x, double*y){
 	free_number(arg2);
 
 }
+static int mp_set_numeric_internal(MP mp, char* n, double value, double* old) {
+	mp_sym p = mp_id_lookup(mp, n, strlen(n), false);
+	if (p == NULL || eq_type(p) != mp_internal_quantity) {
+		return 0;
+	}
+	if (old != NULL) {
+		*old = number_to_double(internal_value(equiv(p)));
+	}
+	set_number_from_double(internal_value(equiv(p)), value);
+	return 1;
+}
+mp_glyph_macro mp_prepare_glyph_macro(MP mp, const char* macroname, const char* newname) {
+
+	char defname[64] = "dkglyphmacro_";
+	char* declare = "newinternal dkmacro_count_, dkmacro_code_, dkmacro_lt_, dkmacro_rt_,"
+		"dkmacro_lve_, dkmacro_rve_, dkmacro_ltt_, dkmacro_rtt_, dkmacro_wib_,"
+		"dkmacro_haslve_, dkmacro_hasrve_, dkmacro_hasltt_, dkmacro_hasrtt_, dkmacro_haswib_;";
+	mp_sym p = mp_id_lookup(mp, "dkmacro_count_", strlen("dkmacro_count_"), false);
+
+	if (p == NULL || eq_type(p) != mp_internal_quantity) {
+		int status = mp_execute(mp, declare, strlen(declare));
+		if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+			return NULL;
+		}
+	}
+
+	// glyphMacro names cannot contain digits
+	int count = (int)mp_get_numeric_internal(mp, "dkmacro_count_");
+	size_t len = strlen(defname);
+	do {
+		defname[len++] = 'a' + count % 26;
+		count /= 26;
+	} while (count > 0);
+	defname[len] = '\0';
+
+	// beginchar resets the extra parameters, they are set after it as the interim of Automedina::addchar
+	char* extras =
+		"if dkmacro_haslve_>0: interim left_verticalextratio := dkmacro_lve_; fi;"
+		"if dkmacro_hasrve_>0: interim right_verticalextratio := dkmacro_rve_; fi;"
+		"if dkmacro_hasltt_>0: interim left_tatweeltension := dkmacro_ltt_; fi;"
+		"if dkmacro_hasrtt_>0: interim right_tatweeltension := dkmacro_rtt_; fi;"
+		"if dkmacro_haswib_>0: interim which_in_baseline := dkmacro_wib_; fi;";
+
+	size_t size = strlen(macroname) + strlen(newname) + strlen(extras) + len + 128;
+	char* code = mp_xmalloc(mp, size, 1);
+	snprintf(code, size, "def %s = beginchar(%s,dkmacro_code_,-1,-1,-1);%s%s_(dkmacro_lt_,dkmacro_rt_);endchar; enddef;", defname, newname, extras, macroname);
+
+	int status = mp_execute(mp, code, strlen(code));
+	mp_xfree(code);
+	if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+		return NULL;
+	}
+
+	mp_set_numeric_internal(mp, "dkmacro_count_", mp_get_numeric_internal(mp, "dkmacro_count_") + 1, NULL);
+
+	return mp_id_lookup(mp, defname, strlen(defname), false);
+}
+static int mp_run_glyph_macro(MP mp, mp_glyph_macro glyphMacro, const GlyphMacroParameters* params) {
+
+	char* names[] = { "dkmacro_lve_", "dkmacro_rve_", "dkmacro_ltt_", "dkmacro_rtt_", "dkmacro_wib_" };
+	char* hasNames[] = { "dkmacro_haslve_", "dkmacro_hasrve_", "dkmacro_hasltt_", "dkmacro_hasrtt_", "dkmacro_haswib_" };
+	int has[] = { params->has_leftextratio, params->has_rightextratio, params->has_left_tatweeltension, params->has_right_tatweeltension, params->has_which_in_baseline };
+	double values[] = { params->leftextratio, params->rightextratio, params->left_tatweeltension, params->right_tatweeltension, params->which_in_baseline };
+
+	mp->history = mp_spotless;
+
+	mp_set_numeric_internal(mp, "dkmacro_code_", params->charcode, NULL);
+	mp_set_numeric_internal(mp, "dkmacro_lt_", params->lefttatweel, NULL);
+	mp_set_numeric_internal(mp, "dkmacro_rt_", params->righttatweel, NULL);
+
+	// read by the interim of the macro once beginchar has reset the glyph internals
+	for (int i = 0; i < 5; i++) {
+		mp_set_numeric_internal(mp, hasNames[i], has[i] ? 1 : 0, NULL);
+		mp_set_numeric_internal(mp, names[i], has[i] ? values[i] : 0, NULL);
+	}
+
+	if (setjmp(*(mp->jump_buf)) == 0) {
+
+		// empty terminal input so the run stops once the glyphMacro call is consumed
+		if (mp->run_data.term_in.data)
+			xfree(mp->run_data.term_in.data);
+		mp->run_data.term_in.data = xstrdup("");
+		mp->run_data.term_in.cur = mp->run_data.term_in.data;
+		mp->run_data.term_in.size = 0;
+
+		mp->tally = 0;
+		mp->term_offset = 0;
+		mp->file_offset = 0;
+
+		// starts an empty terminal line as mp_execute does, otherwise the rest of the previous line is read again
+		(void)mp_input_ln(mp, mp->term_in);
+		mp_firm_up_the_line(mp);
+		mp->buffer[limit] = xord('%');
+		mp->first = (size_t)(limit + 1);
+		loc = start;
+
+		mp_node p = mp_get_symbolic_node(mp);
+		set_mp_sym_sym(p, glyphMacro);
+		mp_name_type(p) = 0;
+		back_list(p);
+
+		do {
+			mp_do_statement(mp);
+		} while (cur_cmd() != mp_stop);
+	}
+
+	return mp->history != mp_error_message_issued && mp->history != mp_fatal_error_stop;
+}
+static int mp_begin_glyph_macros(MP mp) {
+	if (mp->finished || mp->history >= mp_fatal_error_stop) {
+		return 0;
+	}
+
+	mp_reset_stream(&(mp->run_data.term_out));
+	mp_reset_stream(&(mp->run_data.log_out));
+	mp_reset_stream(&(mp->run_data.error_out));
+	mp_reset_stream(&(mp->run_data.ship_out));
+
+	xfree(mp->jump_buf);
+	mp->jump_buf = malloc(sizeof(jmp_buf));
+
+	return mp->jump_buf != NULL;
+}
+mp_edge_object* mp_instantiate_glyph_macro(MP mp, mp_glyph_macro glyphMacro, const GlyphMacroParameters* params) {
+
+	if (glyphMacro == NULL || !mp_begin_glyph_macros(mp)) {
+		return NULL;
+	}
+
+	if (!mp_run_glyph_macro(mp, glyphMacro, params)) {
+		return NULL;
+	}
+
+	return mp_find_edge_by_code(mp, params->charcode);
+}
+int mp_instantiate_glyph_macros(MP mp, int count, const mp_glyph_macro* glyphMacros, const GlyphMacroParameters* params, mp_edge_object** edges) {
+
+	int generated = 0;
+
+	for (int i = 0; i < count; i++) {
+		edges[i] = NULL;
+	}
+
+	if (!mp_begin_glyph_macros(mp)) {
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (glyphMacros[i] == NULL) continue;
+		if (mp_run_glyph_macro(mp, glyphMacros[i], &params[i])) {
+			edges[i] = mp_find_edge_by_code(mp, params[i].charcode);
+			if (edges[i] != NULL) generated++;
+		}
+		else if (mp->history == mp_fatal_error_stop) {
+			break;
+		}
+	}
+
+	return generated;
+}
 /*
 AnchorPoint getAnchor(MP mp, int charcode, int anchorIndex) {
 	AnchorPoint anchor = { NULL,0,0,0 };
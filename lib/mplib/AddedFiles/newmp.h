@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 typedef struct MP_instance*MP;
 //void mymplib_shipout_backend(MP mp, void*voidh);
 
@@ -33,9 +35,55 @@ void setAnchors(MP mp, mp_edge_object* hh);
 
 void mp_gr_toss_objects_extended(mp_edge_object* hh);
 
+// Constant time lookup in mp_rundata(mp)->edges
+mp_edge_object* mp_find_edge_by_code(MP mp, int charcode);
+mp_edge_object* mp_find_edge_by_name(MP mp, const char* charname);
+
+// Removes an edge from mp_rundata(mp)->edges, mp_free_edge also frees it
+void mp_detach_edge(MP mp, mp_edge_object* hh);
+void mp_free_edge(MP mp, mp_edge_object* hh);
+void mp_free_edge_index(MP mp);
+
+// Writes the shipped edges (not the macros nor the symbol table) to fname, key identifies the font sources they were generated from
+int mp_save_shipped_edges(MP mp, const char* fname, const char* key, size_t keylen);
+// Appends the edges of a file saved with the same key to mp_rundata(mp)->edges, returns 0 on failure
+int mp_load_shipped_edges(MP mp, const char* fname, const char* key, size_t keylen);
+// Input run before the next statement, e.g. the font sources of an instance whose edges were loaded from a file.
+// The edges it ships do not replace the existing ones.
+void mp_set_deferred_input(MP mp, const char* input);
+int mp_has_deferred_input(MP mp);
+int mp_run_deferred_input(MP mp);
+
 //AnchorPoint getAnchor(MP mp, int charcode, int anchorIndex);
 //unsigned int getTotalAnchors(MP mp, int charcode);
 //Transform getMatrix(MP mp, int charcode);
 
 void getPointParam(MP mp, int index,double*x, double*y);
 
+typedef struct mp_symbol_entry* mp_glyph_macro;
+
+typedef struct GlyphMacroParameters {
+	int charcode;
+	double lefttatweel;
+	double righttatweel;
+	int has_leftextratio;
+	double leftextratio;
+	int has_rightextratio;
+	double rightextratio;
+	int has_left_tatweeltension;
+	double left_tatweeltension;
+	int has_right_tatweeltension;
+	double right_tatweeltension;
+	int has_which_in_baseline;
+	int which_in_baseline;
+} GlyphMacroParameters;
+
+// Defines once a MetaPost macro shipping <newname> drawn by <macroname>_(lt,rt)
+mp_glyph_macro mp_prepare_glyph_macro(MP mp, const char* macroname, const char* newname);
+
+// Runs a prepared macro from numeric parameters without scanning MetaPost source
+mp_edge_object* mp_instantiate_glyph_macro(MP mp, mp_glyph_macro glyphMacro, const GlyphMacroParameters* params);
+
+// Same for count glyphs in one run, the charcodes must be distinct. edges[i] is NULL if the glyph i failed
+int mp_instantiate_glyph_macros(MP mp, int count, const mp_glyph_macro* glyphMacros, const GlyphMacroParameters* params, mp_edge_object** edges);
+
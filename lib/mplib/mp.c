@@ -2767,6 +2767,8 @@ static void mp_free(MP mp) {
 	mp_free_stream(&(mp->run_data.log_out));
 	mp_free_stream(&(mp->run_data.error_out));
 	mp_free_stream(&(mp->run_data.ship_out));
+	mp_free_edge_index(mp); // Amine
+	xfree(mp->run_data.deferred_input); // Amine
 
 	/*:1064*//*1098:*/
 	// #line 30154 "../../../source/texk/web2c/mplibdir/mp.w"
@@ -25777,6 +25779,9 @@ mp_run_data*mp_rundata(MP mp) {
 // #line 29723 "../../../source/texk/web2c/mplibdir/mp.w"
 
 int mp_execute(MP mp, char*s, size_t l) {
+	if (mp->run_data.deferred_input != NULL && mp_run_deferred_input(mp) >= mp_error_message_issued) { // Amine
+		return mp->history;
+	}
 	mp_reset_stream(&(mp->run_data.term_out));
 	mp_reset_stream(&(mp->run_data.log_out));
 	mp_reset_stream(&(mp->run_data.error_out));
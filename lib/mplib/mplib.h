@@ -362,6 +362,10 @@ mp_stream log_out;
 mp_stream ship_out;
 mp_stream term_in;
 struct mp_edge_object*edges;
+struct mp_edge_object*edges_tail; // Amine
+struct mp_edge_index*edges_index; // Amine
+int keep_shipped_edges; // Amine
+char*deferred_input; // Amine
 }mp_run_data;
 
 /*:1054*//*1276:*/
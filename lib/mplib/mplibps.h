@@ -127,6 +127,10 @@ double xpart;
 double ypart;
 int numAnchors;
 AnchorPoint anchors[10];
+struct mp_edge_object*prev;
+// edges with the same charname in shipping order, the prev of the first one is the last one
+struct mp_edge_object*next_same_name;
+struct mp_edge_object*prev_same_name;
 
 }mp_edge_object;
 
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+/*
+	The alternates of mp_instantiate_glyph_macro and mp_instantiate_glyph_macros must be the glyphs shipped by
+	the MetaPost source of Automedina::addchar for the same parameters. Run from the files directory.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "w2c/config.h"
+#include "mplib.h"
+#include "mplibps.h"
+#include "AddedFiles/newmp.h"
+
+// a kashida on both sides, join reads the tatweel, the tensions, the vertical ratios and which_in_baseline
+static const char* testFont =
+	"defchar(dktestkashida,-1,-1,-1,-1)"
+	"  fill (0,0) join (100,60) -- (200,60) join (300,0) -- (300,-40) -- (0,-40) -- cycle;"
+	"  fill fullcircle scaled 40 shifted (150,120);"
+	"enddefchar;";
+
+#define FIRST_CODE 70000
+
+static double edgeDifference(mp_edge_object* edge1, mp_edge_object* edge2) {
+
+	double error = fabs(edge1->width - edge2->width);
+
+	error = fmax(error, fabs(edge1->xleftanchor - edge2->xleftanchor));
+	error = fmax(error, fabs(edge1->yleftanchor - edge2->yleftanchor));
+	error = fmax(error, fabs(edge1->xrightanchor - edge2->xrightanchor));
+	error = fmax(error, fabs(edge1->yrightanchor - edge2->yrightanchor));
+
+	if (edge1->numAnchors != edge2->numAnchors) {
+		return INFINITY;
+	}
+
+	for (int i = 0; i < edge1->numAnchors; i++) {
+		error = fmax(error, abs(edge1->anchors[i].x - edge2->anchors[i].x));
+		error = fmax(error, abs(edge1->anchors[i].y - edge2->anchors[i].y));
+	}
+
+	mp_graphic_object* body1 = edge1->body;
+	mp_graphic_object* body2 = edge2->body;
+
+	for (; body1 != NULL && body2 != NULL; body1 = body1->next, body2 = body2->next) {
+		if (body1->type != body2->type) {
+			return INFINITY;
+		}
+		if (body1->type != mp_fill_code) continue;
+
+		mp_gr_knot knot1 = ((mp_fill_object*)body1)->path_p;
+		mp_gr_knot knot2 = ((mp_fill_object*)body2)->path_p;
+
+		if (knot1 == NULL || knot2 == NULL) {
+			if (knot1 != knot2) return INFINITY;
+			continue;
+		}
+
+		mp_gr_knot first1 = knot1;
+		do {
+			error = fmax(error, fabs(knot1->x_coord - knot2->x_coord));
+			error = fmax(error, fabs(knot1->y_coord - knot2->y_coord));
+			error = fmax(error, fabs(knot1->left_x - knot2->left_x));
+			error = fmax(error, fabs(knot1->left_y - knot2->left_y));
+			error = fmax(error, fabs(knot1->right_x - knot2->right_x));
+			error = fmax(error, fabs(knot1->right_y - knot2->right_y));
+			knot1 = knot1->next;
+			knot2 = knot2->next;
+		} while (knot1 != first1 && knot2 != ((mp_fill_object*)body2)->path_p);
+
+		if (knot1 != first1 || knot2 != ((mp_fill_object*)body2)->path_p) {
+			return INFINITY;
+		}
+	}
+
+	if (body1 != body2) {
+		return INFINITY;
+	}
+
+	return error;
+}
+
+// the source run by Automedina::addchar
+static mp_edge_object* addchar(MP mp, int charcode, const GlyphMacroParameters* params) {
+
+	char code[1024];
+	int len = snprintf(code, sizeof(code), "beginchar(alternatechar,%d,-1,-1,-1);", charcode);
+
+	if (params->has_leftextratio)
+		len += snprintf(code + len, sizeof(code) - len, "interim left_verticalextratio := %.17g ;", params->leftextratio);
+	if (params->has_rightextratio)
+		len += snprintf(code + len, sizeof(code) - len, "interim right_verticalextratio := %.17g ;", params->rightextratio);
+	if (params->has_left_tatweeltension)
+		len += snprintf(code + len, sizeof(code) - len, "interim left_tatweeltension := %.17g ;", params->left_tatweeltension);
+	if (params->has_right_tatweeltension)
+		len += snprintf(code + len, sizeof(code) - len, "interim right_tatweeltension := %.17g ;", params->right_tatweeltension);
+	if (params->has_which_in_baseline)
+		len += snprintf(code + len, sizeof(code) - len, "interim which_in_baseline := %d ;", params->which_in_baseline);
+
+	len += snprintf(code + len, sizeof(code) - len, "dktestkashida_(%.17g,%.17g);endchar;", params->lefttatweel, params->righttatweel);
+
+	int status = mp_execute(mp, code, len);
+	if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+		printf("addchar failed : %s\n", mp_rundata(mp)->term_out.data);
+		return NULL;
+	}
+
+	return mp_find_edge_by_code(mp, charcode);
+}
+
+int main(void) {
+
+	MP_options* options = mp_options();
+	options->noninteractive = 1;
+	options->command_line = NULL;
+	options->ini_version = 1;
+	options->math_mode = mp_math_double_mode;
+
+	MP mp = mp_initialize(options);
+
+	free(options);
+
+	if (mp == NULL) {
+		printf("could not initialize MetaPost\n");
+		return 1;
+	}
+
+	char* init = "MPGUI:=1;input mpguifont.mp;";
+	int status = mp_execute(mp, init, strlen(init));
+	if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+		printf("could not input mpguifont.mp : %s\n", mp_rundata(mp)->term_out.data);
+		return 1;
+	}
+
+	status = mp_execute(mp, (char*)testFont, strlen(testFont));
+	if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+		printf("could not define the test glyph : %s\n", mp_rundata(mp)->term_out.data);
+		return 1;
+	}
+
+	GlyphMacroParameters tests[5];
+	memset(tests, 0, sizeof(tests));
+
+	tests[0].lefttatweel = 2;
+	tests[0].has_leftextratio = 1;
+	tests[0].leftextratio = 0.5;
+	tests[0].has_left_tatweeltension = 1;
+	tests[0].left_tatweeltension = 1.5;
+
+	tests[1].righttatweel = 1.5;
+	tests[1].has_rightextratio = 1;
+	tests[1].rightextratio = 0.5;
+	tests[1].has_right_tatweeltension = 1;
+	tests[1].right_tatweeltension = 1.5;
+
+	tests[2].lefttatweel = 1;
+	tests[2].has_which_in_baseline = 1;
+	tests[2].which_in_baseline = 1;
+
+	tests[3].lefttatweel = -0.75;
+	tests[3].righttatweel = 3.25;
+
+	// no parameter, the alternate must not keep the ones of the previous glyph
+	tests[4].lefttatweel = 0.5;
+
+	int count = sizeof(tests) / sizeof(*tests);
+	int failures = 0;
+
+	mp_glyph_macro glyphMacro = mp_prepare_glyph_macro(mp, "dktestkashida", "alternatechar");
+	if (glyphMacro == NULL) {
+		printf("could not prepare the glyph macro : %s\n", mp_rundata(mp)->term_out.data);
+		return 1;
+	}
+
+	mp_glyph_macro glyphMacros[5];
+	GlyphMacroParameters batchParams[5];
+	mp_edge_object* batchEdges[5];
+
+	for (int i = 0; i < count; i++) {
+		glyphMacros[i] = glyphMacro;
+		batchParams[i] = tests[i];
+		batchParams[i].charcode = FIRST_CODE + 2 * count + i;
+	}
+
+	int generated = mp_instantiate_glyph_macros(mp, count, glyphMacros, batchParams, batchEdges);
+	if (generated != count) {
+		printf("mp_instantiate_glyph_macros generated %d glyphs out of %d\n", generated, count);
+		failures++;
+	}
+
+	for (int i = 0; i < count; i++) {
+
+		GlyphMacroParameters params = tests[i];
+		params.charcode = FIRST_CODE + i;
+
+		mp_edge_object* macroEdge = mp_instantiate_glyph_macro(mp, glyphMacro, &params);
+		mp_edge_object* sourceEdge = addchar(mp, FIRST_CODE + count + i, &params);
+
+		if (macroEdge == NULL || sourceEdge == NULL) {
+			printf("test %d : %s failed\n", i, macroEdge == NULL ? "mp_instantiate_glyph_macro" : "addchar");
+			failures++;
+			continue;
+		}
+
+		double error = edgeDifference(macroEdge, sourceEdge);
+		if (!(error <= 1e-6)) {
+			printf("test %d : mp_instantiate_glyph_macro differs from addchar, error=%g\n", i, error);
+			failures++;
+		}
+
+		if (batchEdges[i] != NULL) {
+			error = edgeDifference(batchEdges[i], sourceEdge);
+			if (!(error <= 1e-6)) {
+				printf("test %d : mp_instantiate_glyph_macros differs from addchar, error=%g\n", i, error);
+				failures++;
+			}
+		}
+	}
+
+	printf("%d alternates compared, %d failures\n", count, failures);
+
+	mp_finish(mp);
+
+	return failures == 0 ? 0 : 1;
+}
@@ -306,46 +306,38 @@ void ExportToHTML::generateQuranPagesOld(QList<QList<LineLayoutInfo>> pages, int
   file.close();
 }
 
-void ExportToHTML::edgetoHTML5Path(mp_graphic_object* body, QTextStream& out)
+void ExportToHTML::edgetoHTML5Path(const GlyphOutline& outline, QTextStream& out)
 {
 
 
-  if (body) {
+  if (!outline.contours.empty()) {
 
     out << "\tctx.beginPath();\n";
-    do {
-      switch (body->type)
-      {
-      case mp_fill_code: {
-        filltoHTML5Path(((mp_fill_object*)body)->path_p, out);
-
-
-        break;
-      }
-      default:
-        break;
-      }
-
-    } while (body = body->next);
+    for (auto& contour : outline.contours) {
+      filltoHTML5Path(outline, contour, out);
+    }
 
     out << "\tctx.fill();\n";
   }
 
 }
 
-void ExportToHTML::filltoHTML5Path(mp_gr_knot h, QTextStream& out)
+void ExportToHTML::filltoHTML5Path(const GlyphOutline& outline, const GlyphOutline::Contour& contour, QTextStream& out)
 {
-  mp_gr_knot p, q;
+  if (contour.size == 0) return;
 
-  out << "\tctx.moveTo(" << h->x_coord << "," << h->y_coord << ");\n";
-  p = h;
+  int p, q;
+  int first = contour.first;
+
+  out << "\tctx.moveTo(" << outline.x[first] << "," << outline.y[first] << ");\n";
+  p = first;
   do {
-    q = p->next;
-    out << "\tctx.bezierCurveTo(" << p->right_x << "," << p->right_y << "," << q->left_x << "," << q->left_y << "," << q->x_coord << "," << q->y_coord << ");\n";
+    q = outline.next(contour, p);
+    out << "\tctx.bezierCurveTo(" << outline.rightX[p] << "," << outline.rightY[p] << "," << outline.leftX[q] << "," << outline.leftY[q] << "," << outline.x[q] << "," << outline.y[q] << ");\n";
 
     p = q;
-  } while (p != h);
-  if (h->data.types.left_type != mp_endpoint)
+  } while (p != first);
+  if (contour.closed)
     out << "\tctx.closePath()\n";
 
 
@@ -418,37 +410,21 @@ void ExportToHTML::generateGlyph(GlyphVis& glyph, QTextStream& out) {
     out << "\tctx.restore();\n";
   }
   else {
-    edgetoHTML5Path(glyph.copiedPath, out);
+    edgetoHTML5Path(*glyph.outline(), out);
   }
 }
 void ExportToHTML::getImageStream(GlyphVis& glyph, QTextStream& out) {
 
-  if (glyph.m_edge) {
-    mp_graphic_object* body = glyph.m_edge->body;
-    if (body) {
-      do {
-        switch (body->type)
-        {
-        case mp_fill_code: {
-          auto fillobject = (mp_fill_object*)body;
-          out << "\tctx.beginPath();\n";
-          filltoHTML5Path(fillobject->path_p, out);
-          if (fillobject->color_model == mp_rgb_model) {
-            //painter.setBrush(QColor(fillobject->color.a_val, fillobject->color.b_val, fillobject->color.c_val));
-            out << "\tctx.fillStyle = 'rgb(" << fillobject->color.a_val * 255 << "," << fillobject->color.b_val * 255 << "," << fillobject->color.c_val * 255 << ")';\n";
+  auto outline = glyph.outline();
 
-          }
-          out << "\tctx.fill();\n";
-          out << "\tctx.fillStyle = 'rgb(0,0,0)';\n";
-
-          break;
-        }
-        default:
-          break;
-        }
-
-      } while (body = body->next);
+  for (auto& contour : outline->contours) {
+    out << "\tctx.beginPath();\n";
+    filltoHTML5Path(*outline, contour, out);
+    if (contour.hasColor) {
+      out << "\tctx.fillStyle = 'rgb(" << contour.red * 255 << "," << contour.green * 255 << "," << contour.blue * 255 << ")';\n";
     }
+    out << "\tctx.fill();\n";
+    out << "\tctx.fillStyle = 'rgb(0,0,0)';\n";
   }
 
 }
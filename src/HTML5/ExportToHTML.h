@@ -22,6 +22,7 @@
 
 #include "OtLayout.h"
 #include "qtextstream.h"
+#include "GlyphOutline.h"
 
 struct mp_graphic_object;
 typedef struct mp_gr_knot_data*mp_gr_knot;
@@ -34,8 +35,8 @@ public:
 	void generateQuranPages(QList<QList<LineLayoutInfo>> pages, int lineWidth, QList<QStringList> originalText, int scale);
   void generateQuranPagesOld(QList<QList<LineLayoutInfo>> pages, int lineWidth, QList<QStringList> originalText, int scale);
   
-	void edgetoHTML5Path(mp_graphic_object* body, QTextStream& out);
-	void filltoHTML5Path(mp_gr_knot h, QTextStream& out);
+	void edgetoHTML5Path(const GlyphOutline& outline, QTextStream& out);
+	void filltoHTML5Path(const GlyphOutline& outline, const GlyphOutline::Contour& contour, QTextStream& out);
 	void generateGlyph(GlyphVis& glyph, QTextStream & out);
 	void getImageStream(GlyphVis& glyph, QTextStream & out);
 
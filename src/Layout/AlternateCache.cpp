@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "AlternateCache.h"
+#include "GlyphVis.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QtEndian>
+#include <cmath>
+
+extern "C"
+{
+#include "mplibps.h"
+#include "mppsout.h"
+}
+
+static const qint64 headerSize = 8 + 20;
+
+AlternateCache::AlternateCache(OtLayout* layout, bool extended) : m_layout{ layout }, extended{ extended } {
+}
+
+AlternateCache::~AlternateCache() {
+  close();
+}
+
+QByteArray AlternateCache::sourceHash(const QString& directory) {
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  QDir sourceDir(directory);
+
+  QStringList sources = sourceDir.entryList({ "*.mp" }, QDir::Files, QDir::Name);
+  sources.append("lookups.json");
+
+  for (auto& source : sources) {
+    QFile sourceFile(sourceDir.filePath(source));
+    if (sourceFile.open(QIODevice::ReadOnly)) {
+      hash.addData(source.toUtf8());
+      hash.addData(&sourceFile);
+    }
+  }
+
+  return hash.result();
+}
+
+bool AlternateCache::writeHeader(const QByteArray& hash) {
+  QByteArray header;
+  QDataStream out(&header, QIODevice::WriteOnly);
+  out << Magic << Version;
+  out.writeRawData(hash.constData(), 20);
+
+  return file.write(header) == headerSize;
+}
+
+bool AlternateCache::open(const QString& fileName) {
+
+  close();
+
+  file.setFileName(fileName);
+
+  if (!file.open(QIODevice::ReadWrite)) {
+    std::cout << "Cannot open alternate cache " << fileName.toStdString() << '\n';
+    return false;
+  }
+
+  QByteArray hash = sourceHash(QFileInfo(fileName).absolutePath());
+
+  bool valid = false;
+
+  if (file.size() >= headerSize) {
+    QByteArray header = file.read(headerSize);
+    QDataStream in(header);
+    quint32 magic, version;
+    in >> magic >> version;
+    valid = magic == Magic && version == Version && header.mid(8) == hash;
+  }
+
+  if (!valid) {
+    file.resize(0);
+    file.seek(0);
+    if (!writeHeader(hash)) {
+      file.close();
+      return false;
+    }
+    file.flush();
+  }
+
+  dataSize = file.size();
+
+  data = file.map(0, dataSize);
+  if (data == nullptr) {
+    // the file system does not support mapping (e.g. emscripten MEMFS)
+    file.seek(0);
+    unmappedData = file.readAll();
+    data = (const uchar*)unmappedData.constData();
+  }
+
+  indexRecords(headerSize);
+
+  file.seek(file.size());
+
+  return true;
+
+}
+
+void AlternateCache::close() {
+  if (file.isOpen()) {
+    if (unmappedData.isEmpty() && data != nullptr) {
+      file.unmap((uchar*)data);
+    }
+    file.close();
+  }
+  data = nullptr;
+  dataSize = 0;
+  unmappedData.clear();
+  offsets.clear();
+  appended.clear();
+}
+
+void AlternateCache::discard() {
+  if (!file.isOpen()) return;
+
+  QString fileName = file.fileName();
+  close();
+
+  // an empty file gets a new header when it is opened again
+  QFile::resize(fileName, 0);
+}
+
+void AlternateCache::indexRecords(qint64 start) {
+
+  qint64 pos = start;
+
+  while (pos + 4 <= dataSize) {
+    quint32 length = qFromBigEndian<quint32>(data + pos);
+    if (pos + 4 + length > dataSize) {
+      break;
+    }
+    QDataStream in(QByteArray::fromRawData((const char*)data + pos + 4, length));
+    QByteArray key;
+    in >> key;
+    offsets.insert(key, pos);
+    pos += 4 + length;
+  }
+
+  if (pos != dataSize) {
+    std::cout << "Alternate cache truncated at " << pos << '\n';
+    dataSize = pos;
+    if (unmappedData.isEmpty()) {
+      file.unmap((uchar*)data);
+      file.resize(pos);
+      data = file.map(0, dataSize);
+    }
+    else {
+      file.resize(pos);
+      unmappedData.truncate(pos);
+      data = (const uchar*)unmappedData.constData();
+    }
+  }
+}
+
+QByteArray AlternateCache::getKey(const QString& glyphName, const GlyphParameters& parameters) const {
+
+  QByteArray key;
+  QDataStream out(&key, QIODevice::WriteOnly);
+
+  auto writeOptional = [&out](const std::optional<double>& value) {
+    out << (quint8)value.has_value() << (value ? *value : 0.0);
+  };
+
+  out << glyphName << (quint8)extended << parameters.lefttatweel << parameters.righttatweel;
+  writeOptional(parameters.leftextratio);
+  writeOptional(parameters.rightextratio);
+  writeOptional(parameters.left_tatweeltension);
+  writeOptional(parameters.right_tatweeltension);
+  out << (quint8)parameters.which_in_baseline.has_value() << (qint32)parameters.which_in_baseline.value_or(0);
+
+  return key;
+}
+
+bool AlternateCache::load(const QString& glyphName, const GlyphParameters& parameters, GlyphVis& glyph) {
+
+  if (!isOpen()) return false;
+
+  QByteArray key = getKey(glyphName, parameters);
+
+  auto offset = offsets.constFind(key);
+  if (offset != offsets.constEnd()) {
+    quint32 length = qFromBigEndian<quint32>(data + *offset);
+    return readRecord(QByteArray::fromRawData((const char*)data + *offset + 4, length), glyph);
+  }
+
+  auto record = appended.constFind(key);
+  if (record != appended.constEnd()) {
+    return readRecord(*record, glyph);
+  }
+
+  return false;
+}
+
+bool AlternateCache::readRecord(const QByteArray& record, GlyphVis& glyph) {
+
+  QDataStream in(record);
+
+  QByteArray key;
+  QString name, originalglyph;
+  qint32 charcode;
+  in >> key >> name >> originalglyph >> charcode;
+  in >> glyph.width >> glyph.height >> glyph.depth >> glyph.charlt >> glyph.charrt;
+  in >> glyph.bbox.llx >> glyph.bbox.lly >> glyph.bbox.urx >> glyph.bbox.ury;
+  in >> glyph.matrix.xpart >> glyph.matrix.ypart;
+
+  auto readOptionalPoint = [&in](std::optional<QPoint>& point) {
+    quint8 has;
+    QPoint value;
+    in >> has >> value;
+    if (has) {
+      point = value;
+    }
+    else {
+      point.reset();
+    }
+  };
+
+  readOptionalPoint(glyph.leftAnchor);
+  readOptionalPoint(glyph.rightAnchor);
+
+  quint32 nbAnchors;
+  in >> nbAnchors;
+  glyph.anchors.clear();
+  for (quint32 i = 0; i < nbAnchors; i++) {
+    QString anchorName;
+    GlyphVisAnchor anchor;
+    qint32 type;
+    in >> anchorName >> anchor.anchor >> type;
+    anchor.type = type;
+    glyph.anchors.insert(anchorName, anchor);
+  }
+
+  MP mp = m_layout->mp;
+
+  mp_graphic_object* body = nullptr;
+  mp_graphic_object* last = nullptr;
+
+  quint32 nbFills;
+  in >> nbFills;
+  for (quint32 i = 0; i < nbFills && in.status() == QDataStream::Ok; i++) {
+    mp_fill_object* fill = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+    fill->type = mp_fill_code;
+    fill->next = nullptr;
+    fill->pre_script = nullptr;
+    fill->post_script = nullptr;
+    fill->pen_p = nullptr;
+    fill->htap_p = nullptr;
+    fill->path_p = nullptr;
+
+    quint8 colorModel;
+    in >> colorModel >> fill->color.a_val >> fill->color.b_val >> fill->color.c_val >> fill->color.d_val;
+    fill->color_model = colorModel;
+
+    quint32 nbKnots;
+    in >> nbKnots;
+
+    mp_gr_knot current = nullptr;
+    for (quint32 k = 0; k < nbKnots; k++) {
+      mp_gr_knot knot = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+      quint16 left_type, right_type;
+      in >> knot->x_coord >> knot->y_coord >> knot->left_x >> knot->left_y >> knot->right_x >> knot->right_y >> left_type >> right_type;
+      knot->data.types.left_type = left_type;
+      knot->data.types.right_type = right_type;
+      knot->originator = mp_program_code;
+      if (current == nullptr) {
+        fill->path_p = knot;
+      }
+      else {
+        current->next = knot;
+      }
+      current = knot;
+    }
+    if (current != nullptr) {
+      current->next = fill->path_p;
+    }
+
+    if (last == nullptr) {
+      body = (mp_graphic_object*)fill;
+    }
+    else {
+      last->next = (mp_graphic_object*)fill;
+    }
+    last = (mp_graphic_object*)fill;
+  }
+
+  if (in.status() != QDataStream::Ok) {
+    std::cout << "Corrupted alternate cache record for " << name.toStdString() << '\n';
+    mp_graphic_object* p = body;
+    while (p != nullptr) {
+      mp_graphic_object* q = p->next;
+      mp_gr_toss_object(p);
+      p = q;
+    }
+    return false;
+  }
+
+  glyph.name = name;
+  glyph.originalglyph = originalglyph;
+  glyph.charcode = charcode;
+  glyph.m_otLayout = m_layout;
+  glyph.m_edge = nullptr;
+  glyph.copiedPath = body;
+  glyph.isCopiedPath = true;
+
+  glyph.updateOutline();
+
+  return true;
+}
+
+void AlternateCache::store(const QString& glyphName, const GlyphParameters& parameters, mp_edge_object* edge) {
+
+  if (!isOpen()) return;
+
+  QByteArray key = getKey(glyphName, parameters);
+
+  QByteArray record;
+  QDataStream out(&record, QIODevice::WriteOnly);
+
+  QString name = edge->charname;
+  QString originalglyph;
+  if (edge->originalglyph != nullptr && name != edge->originalglyph) {
+    originalglyph = edge->originalglyph;
+  }
+
+  out << key << name << originalglyph << (qint32)edge->charcode;
+  out << edge->width << edge->height << edge->depth << edge->charlt << edge->charrt;
+  if (edge->body == nullptr) {
+    out << 0.0 << 0.0 << 0.0 << 0.0;
+  }
+  else {
+    out << edge->minx << edge->miny << edge->maxx << edge->maxy;
+  }
+  out << edge->xpart << edge->ypart;
+
+  auto writeAnchor = [&out](double x, double y) {
+    if (std::isnan(x)) {
+      out << (quint8)0 << QPoint();
+    }
+    else {
+      out << (quint8)1 << QPoint(round(x), round(y));
+    }
+  };
+
+  writeAnchor(edge->xleftanchor, edge->yleftanchor);
+  writeAnchor(edge->xrightanchor, edge->yrightanchor);
+
+  out << (quint32)edge->numAnchors;
+  for (int i = 0; i < edge->numAnchors; i++) {
+    AnchorPoint& anchor = edge->anchors[i];
+    out << QString(anchor.anchorName) << QPoint(anchor.x, anchor.y) << (qint32)anchor.type;
+  }
+
+  quint32 nbFills = 0;
+  for (mp_graphic_object* body = edge->body; body != nullptr; body = body->next) {
+    if (body->type == mp_fill_code) nbFills++;
+  }
+
+  out << nbFills;
+
+  for (mp_graphic_object* body = edge->body; body != nullptr; body = body->next) {
+    if (body->type != mp_fill_code) continue;
+
+    mp_fill_object* fill = (mp_fill_object*)body;
+
+    out << (quint8)fill->color_model << fill->color.a_val << fill->color.b_val << fill->color.c_val << fill->color.d_val;
+
+    quint32 nbKnots = 0;
+    mp_gr_knot p = fill->path_p;
+    if (p != nullptr) {
+      do {
+        nbKnots++;
+        p = p->next;
+      } while (p != fill->path_p);
+    }
+
+    out << nbKnots;
+
+    p = fill->path_p;
+    for (quint32 k = 0; k < nbKnots; k++) {
+      out << p->x_coord << p->y_coord << p->left_x << p->left_y << p->right_x << p->right_y
+        << (quint16)p->data.types.left_type << (quint16)p->data.types.right_type;
+      p = p->next;
+    }
+  }
+
+  QByteArray length(4, 0);
+  qToBigEndian<quint32>(record.size(), (uchar*)length.data());
+
+  if (file.write(length) != 4 || file.write(record) != record.size()) {
+    std::cout << "Cannot write alternate cache record for " << glyphName.toStdString() << '\n';
+    return;
+  }
+
+  appended.insert(key, record);
+}
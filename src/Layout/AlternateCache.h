@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include "OtLayout.h"
+
+class GlyphVis;
+struct mp_edge_object;
+
+/*
+  On-disk store of the tatweel alternates generated by OtLayout::getAlternate.
+  The file starts with a header (magic, format version, hash of the MetaPost sources and lookups.json of its directory)
+  followed by one record per alternate. The file is memory mapped and a record is only decoded when requested.
+  A header mismatch discards the file content.
+*/
+class AlternateCache {
+public:
+
+  static constexpr quint32 Magic = 0x444B4143; // DKAC
+  static constexpr quint32 Version = 1;
+
+  AlternateCache(OtLayout* layout, bool extended);
+  ~AlternateCache();
+
+  bool open(const QString& fileName);
+  void close();
+  bool isOpen() const { return file.isOpen(); }
+  // the MetaPost glyphs were edited in memory, the records no longer match the sources on disk
+  void discard();
+
+  bool load(const QString& glyphName, const GlyphParameters& parameters, GlyphVis& glyph);
+  void store(const QString& glyphName, const GlyphParameters& parameters, mp_edge_object* edge);
+
+  int size() const { return offsets.size() + appended.size(); }
+
+  static QByteArray sourceHash(const QString& directory);
+
+private:
+  QByteArray getKey(const QString& glyphName, const GlyphParameters& parameters) const;
+  bool readRecord(const QByteArray& record, GlyphVis& glyph);
+  void indexRecords(qint64 start);
+  bool writeHeader(const QByteArray& hash);
+
+  OtLayout* m_layout;
+  bool extended;
+  QFile file;
+  const uchar* data = nullptr;
+  qint64 dataSize = 0;
+  QByteArray unmappedData;
+  QHash<QByteArray, qint64> offsets;
+  QHash<QByteArray, QByteArray> appended;
+};
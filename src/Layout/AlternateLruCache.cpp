@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "AlternateLruCache.h"
+#include "GlyphVis.h"
+#include <stdexcept>
+#include <limits>
+
+extern "C"
+{
+#include "mplibps.h"
+}
+
+AlternateLruCache::~AlternateLruCache() {
+  pins.clear();
+  clear();
+  deleteRetired();
+}
+
+size_t AlternateLruCache::glyphSize(GlyphVis* glyph) {
+
+  size_t size = sizeof(GlyphVis);
+
+  for (mp_graphic_object* body = glyph->copiedPath; body != nullptr; body = body->next) {
+    if (body->type != mp_fill_code) continue;
+
+    size += sizeof(mp_fill_object);
+
+    mp_gr_knot knot = ((mp_fill_object*)body)->path_p;
+    if (knot != nullptr) {
+      mp_gr_knot p = knot;
+      do {
+        size += sizeof(mp_gr_knot_data);
+        p = p->next;
+      } while (p != knot);
+    }
+  }
+
+  auto outline = glyph->outline();
+  size += outline->contours.size() * sizeof(GlyphOutline::Contour) + outline->x.size() * 6 * sizeof(double);
+
+#ifndef DIGITALKHATT_WEBLIB
+  size += glyph->path.elementCount() * sizeof(QPainterPath::Element);
+#endif
+
+  for (auto it = glyph->anchors.constBegin(); it != glyph->anchors.constEnd(); ++it) {
+    size += sizeof(GlyphVisAnchor) + it.key().size() * sizeof(QChar);
+  }
+
+  return size;
+}
+
+GlyphVis* AlternateLruCache::find(Pool pool, int glyphCode, const GlyphParameters& parameters, bool countMiss) {
+
+  auto it = index.find(Key{ pool, glyphCode, parameters });
+
+  if (it == index.end()) {
+    if (countMiss) {
+      m_stats.misses++;
+    }
+    return nullptr;
+  }
+
+  m_stats.hits++;
+
+  lru.splice(lru.begin(), lru, it->second);
+
+  return it->second->glyph;
+}
+
+void AlternateLruCache::insert(Pool pool, int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph, bool owned) {
+
+  Key key{ pool, glyphCode, parameters };
+
+  auto it = index.find(key);
+  if (it != index.end()) {
+    erase(it->second);
+  }
+
+  size_t bytes = owned ? glyphSize(glyph) : 0;
+
+  lru.push_front(Entry{ key, glyph, bytes, owned });
+  index.insert({ key, lru.begin() });
+
+  m_stats.bytes += bytes;
+  m_stats.entries = lru.size();
+
+  evict();
+}
+
+void AlternateLruCache::erase(std::list<Entry>::iterator it) {
+  if (it->owned) {
+    if (!pins.empty()) {
+      retired.push_back({ epoch, it->glyph });
+      m_stats.retired = retired.size();
+    }
+    else {
+      delete it->glyph;
+    }
+  }
+  m_stats.bytes -= it->bytes;
+  index.erase(it->key);
+  lru.erase(it);
+  m_stats.entries = lru.size();
+}
+
+quint64 AlternateLruCache::pin() {
+  pins.insert(++epoch);
+  return epoch;
+}
+
+void AlternateLruCache::unpin(quint64 ticket) {
+  auto it = pins.find(ticket);
+  if (it != pins.end()) {
+    pins.erase(it);
+  }
+  deleteRetired();
+}
+
+void AlternateLruCache::deleteRetired() {
+  // a pin can use a glyph only if it was taken before the glyph was erased
+  quint64 oldest = pins.empty() ? std::numeric_limits<quint64>::max() : *pins.begin();
+
+  auto kept = retired.begin();
+  for (auto& entry : retired) {
+    if (entry.epoch < oldest) {
+      delete entry.glyph;
+    }
+    else {
+      *kept++ = entry;
+    }
+  }
+  retired.erase(kept, retired.end());
+  m_stats.retired = retired.size();
+}
+
+void AlternateLruCache::evict() {
+
+  if (m_budget == 0) return;
+
+  // the most recent entry is kept even if it exceeds the budget alone
+  auto it = lru.end();
+  while (m_stats.bytes > m_budget && it != lru.begin()) {
+    --it;
+    if (it == lru.begin()) break;
+    if (!it->owned) continue;
+    auto victim = it++;
+    erase(victim);
+    m_stats.evictions++;
+  }
+}
+
+void AlternateLruCache::clear(Pool pool) {
+  for (auto it = lru.begin(); it != lru.end();) {
+    auto current = it++;
+    if (current->key.pool == pool) {
+      erase(current);
+    }
+  }
+}
+
+void AlternateLruCache::clear() {
+  while (!lru.empty()) {
+    erase(lru.begin());
+  }
+}
+
+void AlternateLruCache::remapCodes(const QMap<quint16, quint16>& newCodes) {
+
+  for (auto& entry : lru) {
+    if (!newCodes.contains(entry.key.glyphCode)) {
+      throw new std::runtime_error(QString("Code %1 not found").arg(entry.key.glyphCode).toStdString());
+    }
+  }
+
+  index.clear();
+
+  for (auto it = lru.begin(); it != lru.end(); ++it) {
+    it->key.glyphCode = newCodes.value(it->key.glyphCode);
+    index.insert({ it->key, it });
+  }
+}
+
+void AlternateLruCache::setBudget(size_t bytes) {
+  m_budget = bytes;
+  evict();
+}
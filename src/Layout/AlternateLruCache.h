@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <list>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <QMap>
+#include "OtLayout.h"
+
+class GlyphVis;
+
+/*
+  In-memory alternates of OtLayout::getAlternate with LRU eviction.
+  Owned entries are accounted in bytes and evicted when the budget (0 = unlimited) is exceeded.
+  Entries not owned point into OtLayout::glyphs (generated glyphs) and are never evicted.
+  The glyphs returned by find may be used while the caller holds a pin : an erased glyph is retired and only
+  deleted once the pins taken before its eviction are released, the pins taken after cannot find it.
+*/
+class AlternateLruCache {
+public:
+
+  enum class Pool {
+    Default,
+    Justification,
+    // non extended font alternates which are not added to the glyph set
+    Detached
+  };
+
+  struct Stats {
+    quint64 hits = 0;
+    quint64 misses = 0;
+    quint64 evictions = 0;
+    size_t bytes = 0;
+    size_t entries = 0;
+    size_t retired = 0;
+  };
+
+  ~AlternateLruCache();
+
+  // countMiss is false when the lookup falls back to another pool
+  GlyphVis* find(Pool pool, int glyphCode, const GlyphParameters& parameters, bool countMiss = true);
+  void insert(Pool pool, int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph, bool owned);
+
+  void clear(Pool pool);
+  void clear();
+
+  // glyph codes are renumbered by ToOpenType::setGIds
+  void remapCodes(const QMap<quint16, quint16>& newCodes);
+
+  void setBudget(size_t bytes);
+  size_t budget() const { return m_budget; }
+
+  Stats stats() const { return m_stats; }
+
+  // returns the ticket given back to unpin
+  quint64 pin();
+  void unpin(quint64 ticket);
+
+  static size_t glyphSize(GlyphVis* glyph);
+
+private:
+  struct Key {
+    Pool pool;
+    int glyphCode;
+    GlyphParameters parameters;
+
+    bool operator==(const Key& r) const {
+      return pool == r.pool && glyphCode == r.glyphCode && parameters == r.parameters;
+    }
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return std::hash<GlyphParameters>{}(key.parameters) ^ (std::hash<int>{}(key.glyphCode) << 1) ^ ((std::size_t)key.pool << 2);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    GlyphVis* glyph;
+    size_t bytes;
+    bool owned;
+  };
+
+  struct Retired {
+    // last ticket given when the glyph was erased
+    quint64 epoch;
+    GlyphVis* glyph;
+  };
+
+  void evict();
+  void erase(std::list<Entry>::iterator it);
+  // deletes the retired glyphs that no active pin can still use
+  void deleteRetired();
+
+  std::list<Entry> lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+  size_t m_budget = 0;
+  Stats m_stats;
+  quint64 epoch = 0;
+  std::multiset<quint64> pins;
+  std::vector<Retired> retired;
+};
@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "GlyphInterpolator.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <iostream>
+
+extern "C"
+{
+#include "mplibps.h"
+}
+
+GlyphInterpolator::GlyphInterpolator(OtLayout* layout, Generator generator) : m_layout{ layout }, m_generator{ generator } {
+}
+
+GlyphInterpolator::~GlyphInterpolator() {
+}
+
+void GlyphInterpolator::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  mastersPerGlyph.clear();
+  generation++;
+}
+
+void GlyphInterpolator::setTolerance(double tolerance) {
+  if (tolerance != m_tolerance) {
+    // the validity of the masters depends on the tolerance
+    clear();
+  }
+  m_tolerance = tolerance;
+}
+
+void GlyphInterpolator::Masters::free() {
+  delete base;
+  delete maxLeft;
+  delete minLeft;
+  delete maxRight;
+  delete minRight;
+  base = maxLeft = minLeft = maxRight = minRight = nullptr;
+  valid = false;
+  error = 0;
+}
+
+std::shared_ptr<GlyphInterpolator::Masters> GlyphInterpolator::getMasters(const QString& glyphName) {
+
+  quint64 currentGeneration;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto find = mastersPerGlyph.find(glyphName);
+    if (find != mastersPerGlyph.end()) {
+      return find->second;
+    }
+    currentGeneration = generation;
+  }
+
+  // MetaPost runs unlocked, another thread may build the same masters meanwhile
+  auto newMasters = std::make_shared<Masters>();
+
+  buildMasters(glyphName, *newMasters);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (currentGeneration != generation) {
+    return newMasters;
+  }
+
+  return mastersPerGlyph.insert({ glyphName, newMasters }).first->second;
+}
+
+void GlyphInterpolator::buildMasters(const QString& glyphName, Masters& masters) {
+
+  auto find = m_layout->expandableGlyphs.find(glyphName);
+  if (find == m_layout->expandableGlyphs.end()) {
+    return;
+  }
+
+  auto& limits = find->second;
+  masters.limits = limits;
+
+  auto generate = [this, &glyphName](double lefttatweel, double righttatweel) {
+    GlyphParameters parameters{};
+    parameters.lefttatweel = lefttatweel;
+    parameters.righttatweel = righttatweel;
+    return m_generator(glyphName, parameters);
+  };
+
+  masters.base = generate(0.0, 0.0);
+  if (masters.base == nullptr) return;
+
+  if (limits.maxLeft != 0) masters.maxLeft = generate(limits.maxLeft, 0.0);
+  if (limits.minLeft != 0) masters.minLeft = generate(limits.minLeft, 0.0);
+  if (limits.maxRight != 0) masters.maxRight = generate(0.0, limits.maxRight);
+  if (limits.minRight != 0) masters.minRight = generate(0.0, limits.minRight);
+
+  for (auto master : { masters.maxLeft, masters.minLeft, masters.maxRight, masters.minRight }) {
+    if (master != nullptr && !isCompatible(*masters.base, *master)) {
+      std::cout << "Masters of " << glyphName.toStdString() << " are not compatible, using MetaPost\n";
+      masters.free();
+      return;
+    }
+  }
+
+  std::vector<std::pair<double, double>> samples;
+
+  for (double ratio : { 0.3, 0.7 }) {
+    if (limits.maxLeft != 0) samples.push_back({ limits.maxLeft * ratio, 0.0 });
+    if (limits.minLeft != 0) samples.push_back({ limits.minLeft * ratio, 0.0 });
+    if (limits.maxRight != 0) samples.push_back({ 0.0, limits.maxRight * ratio });
+    if (limits.minRight != 0) samples.push_back({ 0.0, limits.minRight * ratio });
+  }
+
+  double left = limits.maxLeft != 0 ? limits.maxLeft : limits.minLeft;
+  double right = limits.maxRight != 0 ? limits.maxRight : limits.minRight;
+  if (left != 0 && right != 0) {
+    samples.push_back({ left * 0.5, right * 0.5 });
+  }
+
+  masters.valid = true;
+  masters.error = 0;
+
+  for (auto& sample : samples) {
+    GlyphParameters parameters{};
+    parameters.lefttatweel = sample.first;
+    parameters.righttatweel = sample.second;
+
+    GlyphVis* reference = m_generator(glyphName, parameters);
+    GlyphVis interpolated;
+
+    double error = std::numeric_limits<double>::infinity();
+    if (reference != nullptr && apply(masters, parameters, interpolated)) {
+      error = distance(*reference, interpolated);
+    }
+
+    delete reference;
+
+    masters.error = std::max(masters.error, error);
+  }
+
+  masters.valid = masters.error <= m_tolerance;
+
+  if (!masters.valid) {
+    std::cout << "Glyph " << glyphName.toStdString() << " is not interpolable, error " << masters.error << '\n';
+  }
+}
+
+bool GlyphInterpolator::interpolate(const QString& glyphName, const GlyphParameters& parameters, GlyphVis& result) {
+
+  if (m_tolerance <= 0) return false;
+
+  // the masters only vary the tatweel axes
+  if (parameters.leftextratio || parameters.rightextratio || parameters.left_tatweeltension
+    || parameters.right_tatweeltension || parameters.which_in_baseline) {
+    return false;
+  }
+
+  if (m_layout->expandableGlyphs.find(glyphName) == m_layout->expandableGlyphs.end()) {
+    return false;
+  }
+
+  auto glyphMasters = getMasters(glyphName);
+
+  if (!glyphMasters->valid) return false;
+
+  return apply(*glyphMasters, parameters, result);
+}
+
+bool GlyphInterpolator::apply(Masters& masters, const GlyphParameters& parameters, GlyphVis& result) {
+
+  auto& limits = masters.limits;
+
+  GlyphVis* left = nullptr;
+  GlyphVis* right = nullptr;
+  double leftRatio = 0;
+  double rightRatio = 0;
+
+  if (parameters.lefttatweel > 0) {
+    if (masters.maxLeft == nullptr || parameters.lefttatweel > limits.maxLeft) return false;
+    left = masters.maxLeft;
+    leftRatio = parameters.lefttatweel / limits.maxLeft;
+  }
+  else if (parameters.lefttatweel < 0) {
+    if (masters.minLeft == nullptr || parameters.lefttatweel < limits.minLeft) return false;
+    left = masters.minLeft;
+    leftRatio = parameters.lefttatweel / limits.minLeft;
+  }
+
+  if (parameters.righttatweel > 0) {
+    if (masters.maxRight == nullptr || parameters.righttatweel > limits.maxRight) return false;
+    right = masters.maxRight;
+    rightRatio = parameters.righttatweel / limits.maxRight;
+  }
+  else if (parameters.righttatweel < 0) {
+    if (masters.minRight == nullptr || parameters.righttatweel < limits.minRight) return false;
+    right = masters.minRight;
+    rightRatio = parameters.righttatweel / limits.minRight;
+  }
+
+  const GlyphVis& base = *masters.base;
+  const GlyphVis& leftMaster = left != nullptr ? *left : base;
+  const GlyphVis& rightMaster = right != nullptr ? *right : base;
+
+  auto value = [leftRatio, rightRatio](double base, double left, double right) {
+    return base + leftRatio * (left - base) + rightRatio * (right - base);
+  };
+
+  auto point = [&value](const QPoint& base, const QPoint& left, const QPoint& right) {
+    return QPoint(std::round(value(base.x(), left.x(), right.x())), std::round(value(base.y(), left.y(), right.y())));
+  };
+
+  result = base;
+
+  result.width = value(base.width, leftMaster.width, rightMaster.width);
+  result.height = value(base.height, leftMaster.height, rightMaster.height);
+  result.depth = value(base.depth, leftMaster.depth, rightMaster.depth);
+  result.charlt = value(base.charlt, leftMaster.charlt, rightMaster.charlt);
+  result.charrt = value(base.charrt, leftMaster.charrt, rightMaster.charrt);
+  result.bbox.llx = value(base.bbox.llx, leftMaster.bbox.llx, rightMaster.bbox.llx);
+  result.bbox.lly = value(base.bbox.lly, leftMaster.bbox.lly, rightMaster.bbox.lly);
+  result.bbox.urx = value(base.bbox.urx, leftMaster.bbox.urx, rightMaster.bbox.urx);
+  result.bbox.ury = value(base.bbox.ury, leftMaster.bbox.ury, rightMaster.bbox.ury);
+  result.matrix.xpart = value(base.matrix.xpart, leftMaster.matrix.xpart, rightMaster.matrix.xpart);
+  result.matrix.ypart = value(base.matrix.ypart, leftMaster.matrix.ypart, rightMaster.matrix.ypart);
+
+  if (base.leftAnchor) {
+    result.leftAnchor = point(*base.leftAnchor, *leftMaster.leftAnchor, *rightMaster.leftAnchor);
+  }
+  if (base.rightAnchor) {
+    result.rightAnchor = point(*base.rightAnchor, *leftMaster.rightAnchor, *rightMaster.rightAnchor);
+  }
+
+  for (auto it = result.anchors.begin(); it != result.anchors.end(); ++it) {
+    it.value().anchor = point(it.value().anchor, leftMaster.anchors.value(it.key()).anchor, rightMaster.anchors.value(it.key()).anchor);
+  }
+
+  mp_graphic_object* object = result.copiedPath;
+  mp_graphic_object* leftObject = leftMaster.copiedPath;
+  mp_graphic_object* rightObject = rightMaster.copiedPath;
+
+  // copyEdgeBody keeps only the fill objects in the same order for all the masters
+  for (; object != nullptr; object = object->next, leftObject = leftObject->next, rightObject = rightObject->next) {
+    mp_gr_knot knot = ((mp_fill_object*)object)->path_p;
+    mp_gr_knot leftKnot = ((mp_fill_object*)leftObject)->path_p;
+    mp_gr_knot rightKnot = ((mp_fill_object*)rightObject)->path_p;
+
+    if (knot == nullptr) continue;
+
+    mp_gr_knot p = knot;
+    do {
+      p->x_coord = value(p->x_coord, leftKnot->x_coord, rightKnot->x_coord);
+      p->y_coord = value(p->y_coord, leftKnot->y_coord, rightKnot->y_coord);
+      p->left_x = value(p->left_x, leftKnot->left_x, rightKnot->left_x);
+      p->left_y = value(p->left_y, leftKnot->left_y, rightKnot->left_y);
+      p->right_x = value(p->right_x, leftKnot->right_x, rightKnot->right_x);
+      p->right_y = value(p->right_y, leftKnot->right_y, rightKnot->right_y);
+      p = p->next;
+      leftKnot = leftKnot->next;
+      rightKnot = rightKnot->next;
+    } while (p != knot);
+  }
+
+  result.m_edge = nullptr;
+
+  result.updateOutline();
+
+  return true;
+}
+
+bool GlyphInterpolator::isCompatible(const GlyphVis& base, const GlyphVis& other) {
+
+  if (base.leftAnchor.has_value() != other.leftAnchor.has_value()
+    || base.rightAnchor.has_value() != other.rightAnchor.has_value()) {
+    return false;
+  }
+
+  if (base.anchors.keys() != other.anchors.keys()) {
+    return false;
+  }
+
+  mp_graphic_object* object1 = base.copiedPath;
+  mp_graphic_object* object2 = other.copiedPath;
+
+  for (; object1 != nullptr && object2 != nullptr; object1 = object1->next, object2 = object2->next) {
+    if (object1->type != mp_fill_code || object2->type != mp_fill_code) {
+      return false;
+    }
+
+    auto fill1 = (mp_fill_object*)object1;
+    auto fill2 = (mp_fill_object*)object2;
+
+    if (fill1->color_model != fill2->color_model) {
+      return false;
+    }
+
+    mp_gr_knot knot1 = fill1->path_p;
+    mp_gr_knot knot2 = fill2->path_p;
+
+    if (knot1 == nullptr || knot2 == nullptr) {
+      if (knot1 != knot2) return false;
+      continue;
+    }
+
+    mp_gr_knot p1 = knot1;
+    mp_gr_knot p2 = knot2;
+    do {
+      if (p1->data.types.left_type != p2->data.types.left_type) {
+        return false;
+      }
+      p1 = p1->next;
+      p2 = p2->next;
+    } while (p1 != knot1 && p2 != knot2);
+
+    if (p1 != knot1 || p2 != knot2) {
+      return false;
+    }
+  }
+
+  return object1 == nullptr && object2 == nullptr;
+}
+
+double GlyphInterpolator::distance(const GlyphVis& glyph1, const GlyphVis& glyph2) {
+
+  if (!isCompatible(glyph1, glyph2)) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  double error = std::abs(glyph1.width - glyph2.width);
+
+  for (auto it = glyph1.anchors.constBegin(); it != glyph1.anchors.constEnd(); ++it) {
+    QPoint diff = it.value().anchor - glyph2.anchors.value(it.key()).anchor;
+    error = std::max(error, (double)std::max(std::abs(diff.x()), std::abs(diff.y())));
+  }
+
+  // compatible outlines have the same knots at the same indexes
+  auto outline1 = glyph1.outline();
+  auto outline2 = glyph2.outline();
+
+  for (size_t i = 0; i < outline1->x.size(); i++) {
+    error = std::max({ error,
+      std::abs(outline1->x[i] - outline2->x[i]), std::abs(outline1->y[i] - outline2->y[i]),
+      std::abs(outline1->leftX[i] - outline2->leftX[i]), std::abs(outline1->leftY[i] - outline2->leftY[i]),
+      std::abs(outline1->rightX[i] - outline2->rightX[i]), std::abs(outline1->rightY[i] - outline2->rightY[i]) });
+  }
+
+  return error;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "OtLayout.h"
+#include "GlyphVis.h"
+
+/*
+  Builds tatweel alternates of expandable glyphs from master outlines instead of running MetaPost.
+  The masters are the default glyph and the four extremes of OtLayout::expandableGlyphs, the alternate is
+  base + left * (leftMaster - base) + right * (rightMaster - base) as in the CFF2 deltas of ToOpenType::charStrings.
+  A glyph is interpolated only if its masters are point compatible and the error against MetaPost
+  on a few samples is within the tolerance.
+*/
+class GlyphInterpolator {
+public:
+  // generates a MetaPost alternate owned by the caller, it is called without any lock of the interpolator
+  typedef std::function<GlyphVis* (const QString& glyphName, const GlyphParameters& parameters)> Generator;
+
+  GlyphInterpolator(OtLayout* layout, Generator generator);
+  ~GlyphInterpolator();
+
+  // thread safe, the masters of a glyph are built on its first call
+  bool interpolate(const QString& glyphName, const GlyphParameters& parameters, GlyphVis& result);
+
+  void clear();
+
+  // maximum error in font units, 0 disables the interpolation
+  void setTolerance(double tolerance);
+  double tolerance() const { return m_tolerance; }
+
+private:
+  struct Masters {
+    bool valid = false;
+    double error = 0;
+    ValueLimits limits;
+    GlyphVis* base = nullptr;
+    GlyphVis* maxLeft = nullptr;
+    GlyphVis* minLeft = nullptr;
+    GlyphVis* maxRight = nullptr;
+    GlyphVis* minRight = nullptr;
+
+    Masters() = default;
+    Masters(const Masters&) = delete;
+    Masters& operator=(const Masters&) = delete;
+    ~Masters() { free(); }
+
+    void free();
+  };
+
+  std::shared_ptr<Masters> getMasters(const QString& glyphName);
+  void buildMasters(const QString& glyphName, Masters& masters);
+
+  bool apply(Masters& masters, const GlyphParameters& parameters, GlyphVis& result);
+
+  static bool isCompatible(const GlyphVis& base, const GlyphVis& other);
+  static double distance(const GlyphVis& glyph1, const GlyphVis& glyph2);
+
+  OtLayout* m_layout;
+  Generator m_generator;
+  std::atomic<double> m_tolerance{ 0 };
+  std::mutex mutex;
+  // incremented by clear so that masters built meanwhile are not kept
+  quint64 generation = 0;
+  // the masters in use by interpolate stay alive after clear
+  std::unordered_map<QString, std::shared_ptr<Masters>> mastersPerGlyph;
+};
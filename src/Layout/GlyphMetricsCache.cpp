@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#include "GlyphMetricsCache.h"
+#include <cmath>
+
+void GlyphMetricsCache::setStep(double step) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (step < 0) {
+    step = 0;
+  }
+  if (step != m_step) {
+    m_step = step;
+    values.clear();
+  }
+}
+
+void GlyphMetricsCache::setMaxEntries(size_t maxEntries) {
+  std::lock_guard<std::mutex> lock(mutex);
+  m_maxEntries = maxEntries;
+}
+
+double GlyphMetricsCache::quantize(double tatweel) const {
+  double step = m_step;
+  if (step == 0 || tatweel == 0) {
+    return tatweel;
+  }
+  return std::round(tatweel / step) * step;
+}
+
+bool GlyphMetricsCache::find(const Key& key, Value& value) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = values.find(key);
+
+  if (it == values.end()) {
+    m_stats.misses++;
+    return false;
+  }
+
+  m_stats.hits++;
+  value = it->second;
+
+  return true;
+}
+
+void GlyphMetricsCache::insert(const Key& key, const Value& value) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (m_maxEntries != 0 && values.size() >= m_maxEntries) {
+    m_stats.resets++;
+    values.clear();
+  }
+  values[key] = value;
+}
+
+void GlyphMetricsCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  values.clear();
+}
+
+GlyphMetricsCache::Stats GlyphMetricsCache::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  m_stats.entries = values.size();
+  return m_stats;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <QtGlobal>
+
+/*
+  Advances and anchors of the tatweel alternates, keyed by glyph code, quantized tatweel values and subtable.
+  The justification loop only needs these metrics, so they are kept when the alternates are evicted from
+  AlternateLruCache or cleared by OtLayout::clearAlternates, and are only dropped by OtLayout::glyphsChanged.
+  There is no metrics-only path: a miss generates the whole alternate through OtLayout::getAlternate,
+  the outline is then generated again only if the glyph is drawn after its eviction.
+*/
+class GlyphMetricsCache {
+public:
+
+  enum class Kind : quint8 {
+    Advance,
+    Entry,
+    Exit,
+    BaseAnchor,
+    MarkAnchor
+  };
+
+  struct Key {
+    // subtable of the anchor, nullptr for advances
+    const void* owner;
+    quint16 glyphCode;
+    // base glyph of the mark anchors
+    quint16 otherCode;
+    Kind kind;
+    double lefttatweel;
+    double righttatweel;
+
+    bool operator==(const Key& r) const {
+      return owner == r.owner && glyphCode == r.glyphCode && otherCode == r.otherCode && kind == r.kind
+        && lefttatweel == r.lefttatweel && righttatweel == r.righttatweel;
+    }
+  };
+
+  struct Value {
+    // false for anchors not defined by the subtable
+    bool exists = false;
+    // x holds the advance of Kind::Advance
+    double x = 0;
+    double y = 0;
+  };
+
+  struct Stats {
+    quint64 hits = 0;
+    quint64 misses = 0;
+    quint64 resets = 0;
+    size_t entries = 0;
+  };
+
+  // step of the tatweel values in the keys, 0 = exact values
+  void setStep(double step);
+  double step() const { return m_step; }
+
+  // the values are dropped when the number of entries exceeds the limit, 0 = unlimited
+  void setMaxEntries(size_t maxEntries);
+
+  double quantize(double tatweel) const;
+
+  bool find(const Key& key, Value& value);
+  void insert(const Key& key, const Value& value);
+
+  // compute runs unlocked since it may generate the alternate
+  template<typename Compute>
+  Value get(const Key& key, Compute compute) {
+    Value value;
+    if (find(key, value)) {
+      return value;
+    }
+    value = compute();
+    insert(key, value);
+    return value;
+  }
+
+  void clear();
+
+  Stats stats();
+
+private:
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return std::hash<const void*>{}(key.owner) ^ (std::hash<quint32>{}(((quint32)key.glyphCode << 16) | key.otherCode) << 1)
+        ^ ((std::size_t)key.kind << 2) ^ std::hash<double>{}(key.lefttatweel) ^ (std::hash<double>{}(key.righttatweel) << 3);
+    }
+  };
+
+  std::mutex mutex;
+  std::unordered_map<Key, Value, KeyHash> values;
+  std::atomic<double> m_step{ 0 };
+  size_t m_maxEntries = 1 << 20;
+  Stats m_stats;
+};
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "GlyphOutline.h"
+
+extern "C"
+{
+#include "mplibps.h"
+}
+
+GlyphOutline::GlyphOutline(mp_graphic_object* body) {
+
+  size_t knotCount = 0;
+  size_t fillCount = 0;
+
+  for (mp_graphic_object* object = body; object != nullptr; object = object->next) {
+    if (object->type != mp_fill_code) continue;
+    fillCount++;
+    mp_gr_knot knot = ((mp_fill_object*)object)->path_p;
+    if (knot != nullptr) {
+      mp_gr_knot p = knot;
+      do {
+        knotCount++;
+        p = p->next;
+      } while (p != knot);
+    }
+  }
+
+  contours.reserve(fillCount);
+  x.reserve(knotCount);
+  y.reserve(knotCount);
+  leftX.reserve(knotCount);
+  leftY.reserve(knotCount);
+  rightX.reserve(knotCount);
+  rightY.reserve(knotCount);
+
+  for (mp_graphic_object* object = body; object != nullptr; object = object->next) {
+    if (object->type != mp_fill_code) continue;
+
+    mp_fill_object* fill = (mp_fill_object*)object;
+
+    Contour contour;
+    contour.first = (int)x.size();
+
+    if (fill->color_model == mp_rgb_model) {
+      contour.hasColor = true;
+      contour.red = fill->color.a_val;
+      contour.green = fill->color.b_val;
+      contour.blue = fill->color.c_val;
+    }
+
+    mp_gr_knot knot = fill->path_p;
+    if (knot != nullptr) {
+      contour.closed = knot->data.types.left_type != mp_endpoint;
+      mp_gr_knot p = knot;
+      do {
+        x.push_back(p->x_coord);
+        y.push_back(p->y_coord);
+        leftX.push_back(p->left_x);
+        leftY.push_back(p->left_y);
+        rightX.push_back(p->right_x);
+        rightY.push_back(p->right_y);
+        p = p->next;
+      } while (p != knot);
+    }
+
+    contour.size = (int)x.size() - contour.first;
+    contours.push_back(contour);
+  }
+}
+
+GlyphOutline::GlyphOutline(const GlyphOutline& source, const std::vector<int>& contourIndexes) {
+
+  contours.reserve(contourIndexes.size());
+
+  for (int index : contourIndexes) {
+    const Contour& sourceContour = source.contours[index];
+
+    Contour contour;
+    contour.first = (int)x.size();
+    contour.size = sourceContour.size;
+    contour.closed = sourceContour.closed;
+
+    auto begin = sourceContour.first;
+    auto end = sourceContour.first + sourceContour.size;
+
+    x.insert(x.end(), source.x.begin() + begin, source.x.begin() + end);
+    y.insert(y.end(), source.y.begin() + begin, source.y.begin() + end);
+    leftX.insert(leftX.end(), source.leftX.begin() + begin, source.leftX.begin() + end);
+    leftY.insert(leftY.end(), source.leftY.begin() + begin, source.leftY.begin() + end);
+    rightX.insert(rightX.end(), source.rightX.begin() + begin, source.rightX.begin() + end);
+    rightY.insert(rightY.end(), source.rightY.begin() + begin, source.rightY.begin() + end);
+
+    contours.push_back(contour);
+  }
+}
+
+#ifndef DIGITALKHATT_WEBLIB
+QPainterPath GlyphOutline::contourPath(const Contour& contour) const {
+
+  QPainterPath path;
+
+  if (contour.size == 0) return path;
+
+  int last = contour.first + contour.size - 1;
+
+  path.moveTo(x[contour.first], y[contour.first]);
+  for (int p = contour.first; p < last; p++) {
+    path.cubicTo(rightX[p], rightY[p], leftX[p + 1], leftY[p + 1], x[p + 1], y[p + 1]);
+  }
+  path.cubicTo(rightX[last], rightY[last], leftX[contour.first], leftY[contour.first], x[contour.first], y[contour.first]);
+
+  if (contour.closed)
+    path.closeSubpath();
+
+  return path;
+}
+
+QPainterPath GlyphOutline::toPath() const {
+
+  QPainterPath path;
+
+  path.setFillRule(Qt::WindingFill);
+
+  for (auto& contour : contours) {
+    path.addPath(contourPath(contour));
+  }
+
+  return path;
+}
+#endif
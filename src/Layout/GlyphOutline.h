@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <vector>
+#ifndef DIGITALKHATT_WEBLIB
+#include "qpainterpath.h"
+#endif
+
+struct mp_graphic_object;
+
+/*
+  Immutable outline of a glyph built once from the fill objects of a MetaPost edge.
+  The knots of all the contours are packed in the coordinate arrays, contour i uses the knots
+  [contours[i].first, contours[i].first + contours[i].size) and is closed back to its first knot.
+  Empty fill objects are kept as empty contours so the contours of the tatweel masters stay aligned.
+*/
+class GlyphOutline {
+public:
+  struct Contour {
+    int first = 0;
+    int size = 0;
+    bool closed = true;
+    bool hasColor = false;
+    double red = 0;
+    double green = 0;
+    double blue = 0;
+  };
+
+  GlyphOutline() = default;
+  explicit GlyphOutline(mp_graphic_object* body);
+  // keeps the given contours only, without their colors
+  GlyphOutline(const GlyphOutline& source, const std::vector<int>& contourIndexes);
+
+  int next(const Contour& contour, int knot) const {
+    return knot + 1 < contour.first + contour.size ? knot + 1 : contour.first;
+  }
+
+  bool isEmpty() const {
+    return x.empty();
+  }
+
+#ifndef DIGITALKHATT_WEBLIB
+  QPainterPath toPath() const;
+  QPainterPath contourPath(const Contour& contour) const;
+#endif
+
+  std::vector<Contour> contours;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> leftX;
+  std::vector<double> leftY;
+  std::vector<double> rightX;
+  std::vector<double> rightY;
+};
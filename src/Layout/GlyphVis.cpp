@@ -28,6 +28,7 @@
 
 #include "automedina/automedina.h"
 #include <cmath>
+#include <cstring>
 
 extern "C"
 {
@@ -45,15 +46,20 @@ GlyphVis::GlyphVis() {
 GlyphVis::~GlyphVis()
 {
   if (copiedPath && isCopiedPath) {
-    mp_graphic_object* p, *q;
-
-    p = copiedPath;
-    while (p != NULL) {
-      q = p->next;
-      mp_gr_toss_object(p);
-      p = q;
+    if (isArenaPath) {
+      // fill objects and knots are in the block starting with the first fill object
+      mp_xfree(copiedPath);
+    }
+    else {
+      mp_graphic_object* p, *q;
+
+      p = copiedPath;
+      while (p != NULL) {
+        q = p->next;
+        mp_gr_toss_object(p);
+        p = q;
+      }
     }
-
   }
 
 }
@@ -83,11 +89,16 @@ GlyphVis::GlyphVis(const GlyphVis& other) {
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  isArenaPath = false;
 
   if (other.copiedPath && isCopiedPath) {
     copiedPath =  copyEdgeBody();
+    isArenaPath = true;
   }
 
+  // the outline is immutable, the copy shares it
+  m_outline = other.m_outline;
+
   expanded = other.expanded;
 
   //paths = other.paths;
@@ -120,11 +131,14 @@ GlyphVis::GlyphVis(GlyphVis&& other)
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  isArenaPath = other.isArenaPath;
 
   isdirty = other.isdirty;
   m_edge = other.m_edge;
   m_otLayout = other.m_otLayout;
 
+  m_outline = std::move(other.m_outline);
+
   other.copiedPath = nullptr;
 #ifndef DIGITALKHATT_WEBLIB
   other.path = {};
@@ -161,11 +175,16 @@ GlyphVis& GlyphVis::operator=(const GlyphVis& other) {
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  isArenaPath = false;
 
   if (other.copiedPath && isCopiedPath) {
     copiedPath =  copyEdgeBody();
+    isArenaPath = true;
   }
 
+  // the outline is immutable, the copy shares it
+  m_outline = other.m_outline;
+
   expanded = other.expanded;
 
   return *this;
@@ -292,24 +311,19 @@ GlyphVis::GlyphVis(OtLayout* otLayout, mp_edge_object* edge, bool copyPath) {
 
   //matrix = getMatrix(m_otLayout->mp, charcode);
   matrix = { m_edge->xpart,m_edge->ypart };
-#ifndef DIGITALKHATT_WEBLIB
-  if (name != "endofaya") {
-    path = getPath(m_edge);
-  }
-  else {
-    picture = getPicture(m_edge);
-    path = getPath(m_edge);
-  }
-#endif
+
   if (copyPath) {
     isCopiedPath = true;
     copiedPath =  this->copyEdgeBody();
+    isArenaPath = true;
   }
   else {
     isCopiedPath = false;
     this->copiedPath = m_edge != nullptr ? m_edge->body : nullptr;
   }
 
+  updateOutline();
+
 
   for (int i = 0; i < m_edge->numAnchors; i++) {
     AnchorPoint anchor = m_edge->anchors[i];
@@ -343,146 +357,105 @@ QPoint GlyphVis::getAnchor(QString name) {
 }
 
 mp_graphic_object* GlyphVis::copyEdgeBody() {
-  mp_graphic_object* result = nullptr;
 
   mp_edge_object* h = edge();
 
-  auto copypath = [](mp_gr_knot knot,OtLayout* layout)
-  {
-    mp_gr_knot p, current, ret;
+  if (!h && !copiedPath) return nullptr;
 
-    ret = nullptr;
+  // copiedPath is set when copying another GlyphVis which may not have an edge (e.g. loaded from AlternateCache)
+  mp_graphic_object* body = copiedPath ? copiedPath : h->body;
 
-    if (knot == nullptr) return ret;
+  size_t fillCount = 0;
+  size_t knotCount = 0;
 
-    ret = (mp_gr_knot)mp_xmalloc(layout->mp, 1, sizeof(struct mp_gr_knot_data)); //new mp_gr_knot_data();
-
-    ret->x_coord = knot->x_coord;
-    ret->y_coord = knot->y_coord;
-    ret->left_x = knot->left_x;
-    ret->left_y = knot->left_y;
-    ret->right_x = knot->right_x;
-    ret->right_y = knot->right_y;
-    ret->data.types.left_type = knot->data.types.left_type;
-    ret->next = nullptr;
+  for (mp_graphic_object* object = body; object != nullptr; object = object->next) {
+    if (object->type != mp_fill_code) continue;
+    fillCount++;
+    mp_gr_knot knot = ((mp_fill_object*)object)->path_p;
+    if (knot != nullptr) {
+      mp_gr_knot p = knot;
+      do {
+        knotCount++;
+        p = p->next;
+      } while (p != knot);
+    }
+  }
 
-    current = ret;
+  if (fillCount == 0) return nullptr;
 
-    p = knot->next;
-    while (p != knot) {
+  // one block for the whole outline, the fill objects first then the knots, released at once by the destructor
+  char* block = (char*)mp_xmalloc(m_otLayout->mp, 1, fillCount * sizeof(mp_fill_object) + knotCount * sizeof(mp_gr_knot_data));
 
+  mp_fill_object* fills = (mp_fill_object*)block;
+  mp_gr_knot knots = (mp_gr_knot)(block + fillCount * sizeof(mp_fill_object));
 
-      mp_gr_knot tmp = (mp_gr_knot)mp_xmalloc(layout->mp, 1, sizeof(struct mp_gr_knot_data)); // new mp_gr_knot_data();
+  memset(fills, 0, fillCount * sizeof(mp_fill_object));
 
-      tmp->left_x = p->left_x;
-      tmp->left_y = p->left_y;
-      tmp->x_coord = p->x_coord;
-      tmp->y_coord = p->y_coord;
-      tmp->right_x = p->right_x;
-      tmp->right_y = p->right_y;
-      tmp->data.types.left_type = p->data.types.left_type;
+  mp_fill_object* currObject = nullptr;
 
+  for (mp_graphic_object* object = body; object != nullptr; object = object->next) {
+    if (object->type != mp_fill_code) continue;
 
+    mp_fill_object* fillobject = (mp_fill_object*)object;
+    mp_fill_object* nextObject = fills++;
 
-      current->next = tmp;
-      current = tmp;
+    nextObject->type = mp_fill_code;
 
-      p = p->next;
+    if (fillobject->color_model == mp_rgb_model) {
+      nextObject->color_model = mp_rgb_model;
+      nextObject->color = fillobject->color;
     }
 
-    current->next = ret;
-
-    return ret;
-  };
-
-
-  if (h) {
-
-
-    mp_graphic_object* body = h->body;
-    mp_graphic_object* currObject = nullptr;
-
-    if (body) {
+    mp_gr_knot knot = fillobject->path_p;
+    if (knot != nullptr) {
+      mp_gr_knot first = knots;
+      mp_gr_knot p = knot;
       do {
-        switch (body->type)
-        {
-          case mp_fill_code: {
-
-              mp_fill_object* fillobject = (mp_fill_object*)body;
-              mp_gr_knot newpath = copypath(fillobject->path_p, m_otLayout);
-
-              mp_fill_object* nextObject = (mp_fill_object * )mp_new_graphic_object(m_otLayout->mp, mp_fill_code); // new mp_fill_object;
-              nextObject->type = mp_fill_code;
-              nextObject->path_p = newpath;
-              nextObject->next = nullptr;
-              nextObject->pre_script = nullptr;
-              nextObject->post_script = nullptr;
-              nextObject->pen_p = nullptr;
-              nextObject->htap_p = nullptr;
-
-              if (fillobject->color_model == mp_rgb_model) {
-                nextObject->color_model = mp_rgb_model;
-                nextObject->color = fillobject->color;
-              }
-
-              if (currObject == nullptr) {
-                currObject = (mp_graphic_object*)nextObject;
-                result = currObject;
-              }
-              else {
-                currObject->next = (mp_graphic_object*)nextObject;
-                currObject = currObject->next;
-              }
-
-
-              break;
-            }
-          default:
-            break;
-        }
+        mp_gr_knot tmp = knots++;
+
+        tmp->x_coord = p->x_coord;
+        tmp->y_coord = p->y_coord;
+        tmp->left_x = p->left_x;
+        tmp->left_y = p->left_y;
+        tmp->right_x = p->right_x;
+        tmp->right_y = p->right_y;
+        tmp->data.types.left_type = p->data.types.left_type;
+        tmp->next = knots;
+
+        p = p->next;
+      } while (p != knot);
+
+      (knots - 1)->next = first;
+      nextObject->path_p = first;
+    }
 
-      } while (body = body->next);
+    if (currObject != nullptr) {
+      currObject->next = (mp_graphic_object*)nextObject;
     }
+    currObject = nextObject;
   }
 
-  return result;
+  return (mp_graphic_object*)block;
 
 }
-#ifndef DIGITALKHATT_WEBLIB
-QPainterPath GlyphVis::getPath(mp_edge_object* h) {
-
-  QPainterPath localpath;
-
-  localpath.setFillRule(Qt::WindingFill);
-
-
-  if (h) {
-    mp_graphic_object* body = h->body;
-
-
-    if (body) {
-
-      do {
-        switch (body->type)
-        {
-          case mp_fill_code: {
-              QPainterPath subpath = mp_dump_solved_path(((mp_fill_object*)body)->path_p);
-              localpath.addPath(subpath);
+std::shared_ptr<const GlyphOutline> GlyphVis::outline() const {
+  static const std::shared_ptr<const GlyphOutline> empty = std::make_shared<const GlyphOutline>();
+  return m_outline ? m_outline : empty;
+}
 
+void GlyphVis::updateOutline() {
 
-              break;
-            }
-          default:
-            break;
-        }
+  m_outline = std::make_shared<const GlyphOutline>(copiedPath);
 
-      } while (body = body->next);
-    }
+#ifndef DIGITALKHATT_WEBLIB
+  path = m_outline->toPath();
+  if (name == "endofaya") {
+    picture = getPicture(*m_outline);
   }
-
-  return localpath;
+#endif
 }
-QPicture GlyphVis::getPicture(mp_edge_object* h)
+#ifndef DIGITALKHATT_WEBLIB
+QPicture GlyphVis::getPicture(const GlyphOutline& outline)
 {
 
   QPicture pic;
@@ -490,34 +463,9 @@ QPicture GlyphVis::getPicture(mp_edge_object* h)
 
   painter.begin(&pic);
 
-  if (h) {
-    mp_graphic_object* body = h->body;
-
-
-    if (body) {
-
-      do {
-        switch (body->type)
-        {
-          case mp_fill_code: {
-              auto fillobject = (mp_fill_object*)body;
-              QPainterPath subpath = mp_dump_solved_path(fillobject->path_p);
-              if (fillobject->color_model == mp_rgb_model) {
-                //painter.setBrush(QColor(fillobject->color.a_val, fillobject->color.b_val, fillobject->color.c_val));
-                painter.fillPath(subpath, QColor(fillobject->color.a_val * 255, fillobject->color.b_val * 255, fillobject->color.c_val * 255));
-              }
-              else {
-                int t = 5;
-              }
-
-
-              break;
-            }
-          default:
-            break;
-        }
-
-      } while (body = body->next);
+  for (auto& contour : outline.contours) {
+    if (contour.hasColor) {
+      painter.fillPath(outline.contourPath(contour), QColor(contour.red * 255, contour.green * 255, contour.blue * 255));
     }
   }
 
@@ -525,24 +473,4 @@ QPicture GlyphVis::getPicture(mp_edge_object* h)
 
   return pic;
 }
-
-QPainterPath GlyphVis::mp_dump_solved_path(mp_gr_knot h) {
-  mp_gr_knot p, q;
-  QPainterPath path;
-  //path.setFillRule(Qt::OddEvenFill);
-  if (h == NULL) return path;
-
-  path.moveTo(h->x_coord, h->y_coord);
-  p = h;
-  do {
-    q = p->next;
-    path.cubicTo(p->right_x, p->right_y, q->left_x, q->left_y, q->x_coord, q->y_coord);
-
-    p = q;
-  } while (p != h);
-  if (h->data.types.left_type != mp_endpoint)
-    path.closeSubpath();
-
-  return path;
-}
 #endif
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <optional>
+#include <memory>
 
 #include "font.hpp"
 #include "qstring.h"
@@ -31,6 +32,7 @@
 #include "qmap.h"
 #include <unordered_map>
 #include "OtLayout.h"
+#include "GlyphOutline.h"
 
 extern "C"
 {
@@ -53,6 +55,8 @@ struct GlyphVisAnchor {
 class GlyphVis {
 	friend class MyQPdfEnginePrivate;
 	friend class ExportToHTML;
+	friend class AlternateCache;
+	friend class GlyphInterpolator;
 public:
 	struct BBox {
 	  double llx = 0;
@@ -98,6 +102,8 @@ public:
 		return m_edge;
 	}
 
+	std::shared_ptr<const GlyphOutline> outline() const;
+
 
 
 	GlyphVis* getAlternate(GlyphParameters parameters);
@@ -109,11 +115,10 @@ public:
     mp_graphic_object* copyEdgeBody();
 
 private:
+	// rebuilds the outline, the path and the picture from copiedPath
+	void updateOutline();
 #ifndef DIGITALKHATT_WEBLIB
-	QPainterPath getPath(mp_edge_object* h);
-	QPicture getPicture(mp_edge_object* h);
-	QPainterPath mp_dump_solved_path(mp_gr_knot h);
-	
+	QPicture getPicture(const GlyphOutline& outline);
 #endif
 	
 	
@@ -121,6 +126,9 @@ private:
 	mp_edge_object* m_edge = nullptr;
 	OtLayout * m_otLayout = nullptr;
 	bool isCopiedPath = false;
+	// copiedPath is a single block allocated by copyEdgeBody
+	bool isArenaPath = false;
+	std::shared_ptr<const GlyphOutline> m_outline;
 
 
 
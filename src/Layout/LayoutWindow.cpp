@@ -50,10 +50,12 @@
 
 #include "Lookup.h"
 #include "GlyphVis.h"
+#include "AlternateLruCache.h"
 #include "qpoint.h"
 #include "automedina/automedina.h"
 
 #include <vector>
+#include <limits>
 
 #if defined(ENABLE_PDF_GENERATION)
 #include "Pdf/quranpdfwriter.h"
@@ -119,6 +121,12 @@ LayoutWindow::LayoutWindow(Font* font, QWidget* parent, Qt::WindowFlags flags) :
 	createActions();
 	createDockWindows();
 
+	for (auto glyph : m_font->glyphs) {
+		connect(glyph, &Glyph::valueChanged, this, &LayoutWindow::glyphChanged);
+	}
+
+	updateAlternateSources();
+
 	setQutranText(1);
 
 	integerSpinBox->setValue(3);
@@ -255,6 +263,18 @@ void LayoutWindow::createActions()
 
 	jutifyToolbar->addWidget(toggleButton);
 
+	toggleButton = new QPushButton(tr("&Interpolation"));
+	toggleButton->setCheckable(true);
+	toggleButton->setChecked(false);
+	toggleButton->setToolTip(tr("Interpolate the tatweel alternates from masters within 1 font unit of MetaPost"));
+
+	connect(toggleButton, &QPushButton::toggled, [&](bool checked) {
+		m_otlayout->setInterpolationTolerance(checked ? 1.0 : 0.0);
+		executeRunText(true, 1);
+	});
+
+	jutifyToolbar->addWidget(toggleButton);
+
 	toggleButton = new QPushButton(tr("&Collision Detection"));
 	toggleButton->setCheckable(true);
 	toggleButton->setChecked(false);
@@ -421,147 +441,58 @@ bool LayoutWindow::exportpdf() {
 	return true;
 }
 
-LayoutPages LayoutWindow::shapeMedina(int scale, int lineWidth) {
-
-	loadLookupFile("lookups.json");
-
-	QList<QList<LineLayoutInfo>> pages;
-	QStringList originalPage;
-	QList<QStringList> originalPages;
-
-	QString suraWord = "سُورَةُ";
-	QString bism = "بِسْمِ ٱللَّهِ ٱلرَّحْمَٰنِ ٱلرَّحِيمِ";
-
-	QString surapattern = "^("
-		+ suraWord + " .*|"
-		+ bism
-		+ "|" + "بِّسْمِ ٱللَّهِ ٱلرَّحْمَٰنِ ٱلرَّحِيمِ"
-		+ ")$";
-
-	QRegularExpression surabism(surapattern, QRegularExpression::MultilineOption);
-
-	bool newface = true;
-
-
-	QString sajdapatterns = "(وَٱسْجُدْ) وَٱقْتَرِب|(خَرُّوا۟ سُجَّدࣰا)|(وَلِلَّهِ يَسْجُدُ)|(يَسْجُدُونَ)۩|(فَٱسْجُدُوا۟ لِلَّهِ)|(وَٱسْجُدُوا۟ لِلَّهِ)|(أَلَّا يَسْجُدُوا۟ لِلَّهِ)|(وَخَرَّ رَاكِعࣰا)|(يَسْجُدُ لَهُ)|(يَخِرُّونَ لِلْأَذْقَانِ سُجَّدࣰا)|(ٱسْجُدُوا۟) لِلرَّحْمَٰنِ|ٱرْكَعُوا۟ (وَٱسْجُدُوا۟)"; // sajdapatterns.replace("\u0657", "\u08F0").replace("\u065E", "\u08F1").replace("\u0656", "\u08F2");
-	QRegularExpression sajdaRe = QRegularExpression(sajdapatterns, QRegularExpression::MultilineOption);
-
-	int beginsajda = 0;
-	int endsajda = 0;
-	int sajdamatched = 0;
-
-	for (int pagenum = 0; pagenum < 604; pagenum++) {
-
-		//if (pagenum == 155) {
-		//	auto test = 5;
-		//}
-
-		QString textt = QString::fromUtf8(qurantext[pagenum] + 1);
-
-		textt = textt.replace(QRegularExpression(" *" + QString("۞") + " *"), QString("۞") + " ");
-
-		auto lines = textt.split(char(10), Qt::SkipEmptyParts);
-
-		auto justification = LineJustification::Distribute;
-		int beginsura = OtLayout::TopSpace << OtLayout::SCALEBY;
-
-		if (pagenum == 0 || pagenum == 1) {
-			justification = LineJustification::Center;
-			beginsura = (OtLayout::TopSpace + (OtLayout::InterLineSpacing * 3)) << OtLayout::SCALEBY;
-		}
-
-		auto page = m_otlayout->justifyPage(scale, lineWidth, lineWidth, lines, justification, newface, true);
-
-		newface = false;
-
-		//int currentyPos = TopSpace;
-
-		for (int i = 0; i < page.size(); ++i) {
-
-			auto& currentpage = page[i];
-
-			// check if suran name or bism
-			auto match = surabism.match(lines[i]);
-			if (match.hasMatch()) {
-
-				auto temp = m_otlayout->justifyPage(scale, lineWidth, lineWidth, { lines[i] }, LineJustification::Center, false, true);
-
-				if (match.captured(0).startsWith("سُ")) {
-					temp[0].type = LineType::Sura;
-				}
-				else {
-					temp[0].type = LineType::Bism;
-				}
-
-				page[i] = temp[0];
-			}
-			else {
-				// check if sajda
-				match = sajdaRe.match(lines[i]);
-				if (match.hasMatch()) {
-
-					sajdamatched++;
-
-					int startOffset = match.capturedStart(match.lastCapturedIndex()); // startOffset == 6
-					int endOffset = match.capturedEnd(match.lastCapturedIndex()) - 1; // endOffset == 9
-
+void LayoutWindow::glyphChanged() {
+	lastGlyphEdit = QDateTime::currentDateTime();
+	m_otlayout->glyphsChanged();
+}
 
-					while (m_otlayout->glyphGlobalClasses[lines[i][endOffset].unicode()] == OtLayout::MarkGlyph)
-						endOffset--;
+bool LayoutWindow::isFontModified() {
+	// Font::saveFile writes the edited glyphs back to the font file
+	return lastGlyphEdit.isValid() && QFileInfo(m_font->path()).lastModified() < lastGlyphEdit;
+}
 
-					bool beginDone = false;
+void LayoutWindow::updateAlternateSources(int poolSize) {
 
-					auto& glyphs = currentpage.glyphs;
+	// while the edits are not saved the alternates are generated on the main MetaPost instance
+	if (m_font->path().isEmpty() || isFontModified()) return;
 
-					for (auto& glyphLayout : glyphs) {
+	QFileInfo fontFile(m_font->path());
 
-						if (glyphLayout.cluster == startOffset && !beginDone) {
-							glyphLayout.beginsajda = true;
-							beginDone = true;;
-							beginsajda++;
+	// the alternates on disk are only valid for the saved sources next to the font
+	if (!m_otlayout->alternateCache->isOpen()) {
+		m_otlayout->openAlternateCache(fontFile.absolutePath() + "/alternates.cache");
+	}
 
-						}
-						else if (glyphLayout.cluster == endOffset) {
-							glyphLayout.endsajda = true;
-							endsajda++;
-							break;
-						}
+	if (poolSize > 0 && m_otlayout->mpInstancePool == nullptr) {
+		m_otlayout->createMpInstancePool(poolSize, fontFile.absoluteFilePath().toStdString());
+	}
+}
 
-					}
+LayoutPages LayoutWindow::shapeMedina(int scale, int lineWidth) {
 
-				}
-			}
+	loadLookupFile("lookups.json");
 
+	int nbthreads = QThread::idealThreadCount();
 
-			if (i == 0 && (pagenum == 0 || pagenum == 1)) {
-				page[i].type = LineType::Sura;
-				page[i].ystartposition = (OtLayout::TopSpace + (OtLayout::InterLineSpacing * 1)) << OtLayout::SCALEBY;
-			}
-			else {
-				page[i].ystartposition = beginsura;
-				beginsura += OtLayout::InterLineSpacing << OtLayout::SCALEBY;
-			}
-		}
+	// the pages are shaped in parallel, each thread generates its alternates on its own MetaPost instance of the pool
+	updateAlternateSources(nbthreads);
 
+	// the pages are drawn or exported afterwards
+	bool batchAlternates = m_otlayout->batchAlternates;
+	m_otlayout->batchAlternates = true;
 
+	auto result = m_otlayout->shapeMedina(scale, lineWidth, nbthreads);
 
-		pages.append(page);
-		originalPages.append(lines);
-	}
+	m_otlayout->batchAlternates = batchAlternates;
 
-	if (beginsajda != 15 || endsajda != 15 || sajdamatched != 15) {
-		qDebug() << "sajdas problems?";
-	}
+	auto stats = m_otlayout->alternates->stats();
+	std::cout << "Alternates : " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, "
+		<< stats.entries << " entries, " << stats.bytes << " bytes\n";
 
 	if (this->applyCollisionDetection) {
-		adjustOverlapping(pages, lineWidth, originalPages, scale);
+		adjustOverlapping(result.pages, lineWidth, result.originalPages, scale);
 	}
 
-	LayoutPages result;
-
-	result.originalPages = originalPages;
-	result.pages = pages;
-
 	return result;
 
 }
@@ -773,6 +704,8 @@ void LayoutWindow::createDockWindows()
 
 	auto refreshButton = new QPushButton("&Refresh", textRun);
 	connect(refreshButton, &QPushButton::clicked, [=](int i) {
+		m_otlayout->dirty = true;
+		m_otlayout->glyphTablesVersion++;
 		executeRunText(true, 1);
 	});
 
@@ -826,6 +759,12 @@ void LayoutWindow::createDockWindows()
 
 	otherMenu->addAction(action);
 
+	action = new QAction(tr("Search minimum size"), this);
+	action->setStatusTip(tr("Search minimum size from the widths predicted at one scale"));
+	connect(action, &QAction::triggered, this, &LayoutWindow::searchMinimumSize);
+
+	otherMenu->addAction(action);
+
 	action = new QAction(tr("Test kasheda"), this);
 	action->setStatusTip(tr("Test kasheda"));
 	connect(action, &QAction::triggered, this, &LayoutWindow::testKasheda);
@@ -1115,6 +1054,178 @@ void LayoutWindow::calculateMinimumSize() {
 
 }
 
+void LayoutWindow::searchMinimumSize() {
+	loadLookupFile("lookups.json");
+
+	int lineWidth = (17000 - (2 * 400)) << OtLayout::SCALEBY;
+
+	// The lines are justified once at the reference scale against a width they cannot reach, so they are shrunk as much
+	// as possible. The advances scale linearly with emScale, the minimum width of a line at another scale is predicted
+	// from this width and only the lines whose threshold is close to a scale are justified again.
+	const double referenceScale = 0.9;
+	const double margin = 0.01;
+
+	int referenceEmScale = (1 << OtLayout::SCALEBY) * referenceScale;
+
+	struct Line {
+		int pageNumber;
+		int lineNumber;
+		QString text;
+		double minimumWidth; // at the reference scale
+		double threshold; // largest scale where the line fits
+		bool bisected = false; // threshold verified by justifying the line
+	};
+
+	QVector<Line> lines;
+
+	for (int pagenum = 0; pagenum <= 603; pagenum++) {
+
+		QString textt = QString::fromUtf8(qurantext[pagenum] + 1);
+
+		auto pageLines = textt.split(char(10), Qt::SkipEmptyParts);
+
+		auto page = m_otlayout->justifyPage(referenceEmScale, lineWidth / 4, lineWidth, pageLines, LineJustification::Distribute, false, true);
+
+		for (int linenum = 0; linenum < pageLines.length(); linenum++) {
+
+			double minimumWidth = 0;
+			for (auto& glyph : page[linenum].glyphs) {
+				minimumWidth += glyph.x_advance;
+			}
+
+			double threshold = minimumWidth > 0 ? referenceScale * lineWidth / minimumWidth : std::numeric_limits<double>::max();
+
+			lines.append({ pagenum + 1, linenum + 1, pageLines[linenum], minimumWidth, threshold });
+		}
+	}
+
+	auto overflowAt = [&](const Line& line, double scale) {
+		int emScale = (1 << OtLayout::SCALEBY) * scale;
+		auto result = m_otlayout->justifyPage(emScale, lineWidth, lineWidth, QStringList{ line.text }, LineJustification::Distribute, false, true);
+		return (double)result[0].underfull / emScale;
+	};
+
+	double minimumThreshold = std::numeric_limits<double>::max();
+	for (auto& line : lines) {
+		minimumThreshold = std::min(minimumThreshold, line.threshold);
+	}
+
+	// largest scale where the line fits, the bracket is widened until low fits and high overflows
+	auto searchThreshold = [&](const Line& line, double low, double high) {
+		while (overflowAt(line, low) != 0) {
+			high = low;
+			low = low * (1 - 4 * margin);
+			if (low < 0.1) {
+				return 0.0;
+			}
+		}
+
+		while (high < 2 && overflowAt(line, high) == 0) {
+			low = high;
+			high = high * (1 + 4 * margin);
+		}
+
+		while (high - low > 0.001) {
+			double middle = (low + high) / 2;
+			if (overflowAt(line, middle) != 0) {
+				high = middle;
+			}
+			else {
+				low = middle;
+			}
+		}
+
+		return low;
+	};
+
+	// bisects the lines which may set the global scale
+	double globalScale = std::numeric_limits<double>::max();
+
+	for (auto& line : lines) {
+		if (line.threshold > minimumThreshold * (1 + margin)) continue;
+
+		line.threshold = searchThreshold(line, line.threshold * (1 - margin), line.threshold * (1 + margin));
+		line.bisected = true;
+		globalScale = std::min(globalScale, line.threshold);
+	}
+
+	// The prediction is trusted for the lines whose predicted width at the global scale is far from the line width.
+	// The lines inside the band are justified at the global scale, an overflowing line is bisected and lowers it.
+	const double band = 2 * margin;
+	bool verified = false;
+
+	while (!verified && globalScale > 0) {
+		verified = true;
+		for (auto& line : lines) {
+			if (line.bisected) continue;
+
+			double predictedWidth = line.minimumWidth * globalScale / referenceScale;
+			if (predictedWidth < lineWidth * (1 - band)) continue;
+
+			if (overflowAt(line, globalScale) == 0) continue;
+
+			line.threshold = searchThreshold(line, globalScale * (1 - margin), globalScale);
+			line.bisected = true;
+			globalScale = std::min(globalScale, line.threshold);
+			verified = false;
+		}
+	}
+
+	QMap<double, QVector<Line>> alloverflows;
+	QMap<double, QVector<double>> alloverflowValues;
+
+	double scale = 0.8;
+
+	while (scale <= 0.94) {
+
+		int emScale = (1 << OtLayout::SCALEBY) * scale;
+
+		for (auto& line : lines) {
+
+			double overflow = 0;
+
+			if (line.threshold < scale * (1 - margin)) {
+				overflow = (line.minimumWidth * scale / referenceScale - lineWidth) / emScale;
+			}
+			else if (line.threshold <= scale * (1 + margin)) {
+				overflow = overflowAt(line, scale);
+			}
+
+			if (overflow > 0) {
+				alloverflows[scale].append(line);
+				alloverflowValues[scale].append(overflow);
+			}
+		}
+
+		scale = scale + 0.05;
+	}
+
+	QString fileName = "overflows_search.csv";
+
+	if (applyJustification) {
+		fileName = "overflows_search_with_just.csv";
+	}
+
+	QFile file(fileName);
+	file.open(QIODevice::WriteOnly | QIODevice::Text);
+	QTextStream out(&file);
+	out.setCodec("ISO 8859-1");
+
+	for (auto key : alloverflows.keys()) {
+		auto overflow = alloverflows.value(key);
+		auto values = alloverflowValues.value(key);
+		for (int i = 0; i < overflow.size(); i++) {
+			out << key << "," << overflow[i].pageNumber << "," << overflow[i].lineNumber << "," << (std::round)(values[i]) << "\n";
+		}
+	}
+
+	file.close();
+
+	QMessageBox msgBox;
+	msgBox.setText(QString("All the lines fit up to the scale %1").arg(globalScale));
+	msgBox.exec();
+}
+
 void LayoutWindow::setQutranText(int type) {
 
 	currentQuranText.clear();
@@ -1480,15 +1591,28 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
 	std::vector<QThread*> threads;
 	std::vector<QVector<int>*> overlappages;
 
-	// fetch all gryph initially otherwise mpost is not thread safe when executing getAlternate
-	for (auto& page : pages) {
-		for (auto& line : page) {
-			for (auto& glyph : line.glyphs) {
-				//GlyphVis* currentGlyph = 
-				m_otlayout->getGlyph(glyph.codepoint, glyph.lefttatweel, glyph.righttatweel);
+	// fetch all gryph initially, each thread generates its alternates on its own MetaPost instance of the pool
+	updateAlternateSources(nbthreads);
+
+	for (int i = 0; i < nbthreads; i++) {
+		QThread* thread = QThread::create([this, &pages, i, nbthreads] {
+			for (int pageIndex = i; pageIndex < pages.size(); pageIndex += nbthreads) {
+				for (auto& line : pages[pageIndex]) {
+					for (auto& glyph : line.glyphs) {
+						m_otlayout->getGlyph(glyph.codepoint, glyph.lefttatweel, glyph.righttatweel);
+					}
+				}
 			}
-		}
+			});
+		threads.push_back(thread);
+		thread->start();
+	}
+
+	for (auto t : threads) {
+		t->wait();
+		delete t;
 	}
+	threads.clear();
 
 	while (remainingPages != 0) {
 
@@ -1607,6 +1731,9 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
 	for (int p = beginPage; p < beginPage + nbPages; p++) {
 		auto& page = pages[p];
 
+		// the glyphs of the page are not deleted by the evictions of the other threads
+		OtLayout::PinnedAlternates pinned{ m_otlayout };
+
 		QList<QList<QPoint>> pagePositions;
 		bool intersection = false;
 
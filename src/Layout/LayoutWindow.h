@@ -21,6 +21,7 @@
 
 //#include <QtWidgets>
 #include "qmainwindow.h"
+#include <QDateTime>
 #include "OtLayout.h"
 
 class Font;
@@ -59,9 +60,11 @@ protected:
 
 private slots :
 	void calculateMinimumSize();
+	void searchMinimumSize();
 	void testKasheda();
 	void serializeTexPages();
 	void serializeMedinaPages();
+	void glyphChanged();
 
 private:
 	
@@ -77,6 +80,10 @@ private:
 	bool generateAllQuranTexBreaking();
 	bool generateAllQuranTexMedina();
 	LayoutPages shapeMedina(int scale, int lineWidth);
+	// the glyphs were edited since the font file was last saved
+	bool isFontModified();
+	// opens the alternate cache and creates the MetaPost instance pool from the saved font file
+	void updateAlternateSources(int poolSize = 0);
 	void testQuarn();
 	void simpleAdjustPage(hb_buffer_t *buffer);
 	void adjustPage(QString text, hb_font_t* shapeFont, hb_buffer_t *buffer);	
@@ -123,4 +130,6 @@ private:
 
 	bool applyJustification = true;
 	bool applyCollisionDetection = false;
+
+	QDateTime lastGlyphEdit;
 };
@@ -52,6 +52,23 @@ void Lookup::setGlyphSet(QVector<QString> list) {
     flags = flags | Flags::UseMarkFilteringSet;
   }
 }
+void Lookup::resolveCallback() {
+  if (type == Lookup::fsmgsub || type == Lookup::fsmgpos) {
+    callback = Callback::Fsm;
+  }
+  else if (name == "markexpansion.l1") {
+    callback = Callback::MarkExpansion;
+  }
+  else if (name.startsWith("expa.")) {
+    callback = Callback::Expansion;
+  }
+  else if (name.contains("test")) {
+    callback = Callback::Test;
+  }
+  else {
+    callback = Callback::None;
+  }
+}
 void Lookup::readJson(const QJsonObject& jsonsubtable) {
   QString type = jsonsubtable["type"].toString();
 
@@ -160,6 +160,15 @@ public:
     MarkAttachmentType = 0xFF00u
   };
 
+  // processing of the lookup in the shaping callbacks of OtLayout
+  enum class Callback : quint8 {
+    None,
+    MarkExpansion,
+    Expansion,
+    Test,
+    Fsm
+  };
+
   Lookup(OtLayout* layout);
   ~Lookup();
 
@@ -185,6 +194,10 @@ public:
 
   Type type;
 
+  // resolved from the name and the type when the GSUB and GPOS tables are built
+  Callback callback = Callback::None;
+  void resolveCallback();
+
   QVector<Subtable*> getSubtables(bool extended);
 
 };
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "MpInstancePool.h"
+#include <iostream>
+#include <cstdlib>
+
+extern "C"
+{
+#include "mplib.h"
+}
+
+MpInstancePool::MpInstancePool(int size, std::string fontSource, std::function<void(MP)> finishing) : finishing{ finishing } {
+
+  for (int i = 0; i < size; i++) {
+    MP mp = createInstance(fontSource);
+    if (mp == nullptr) {
+      std::cout << "Could not initialize MetaPost instance " << i << " of the pool\n";
+      continue;
+    }
+    instances.push_back(mp);
+  }
+
+  available = instances;
+}
+
+MpInstancePool::~MpInstancePool() {
+  std::unique_lock<std::mutex> lock(mutex);
+  released.wait(lock, [this] { return available.size() == instances.size(); });
+
+  for (auto mp : instances) {
+    if (finishing) {
+      finishing(mp);
+    }
+    mp_finish(mp);
+  }
+}
+
+MP MpInstancePool::createInstance(const std::string& fontSource) {
+
+  MP_options* _mp_options = mp_options();
+  _mp_options->noninteractive = 1;
+  _mp_options->command_line = NULL;
+  _mp_options->ini_version = true;
+  _mp_options->math_mode = mp_math_double_mode;
+
+  MP mp = mp_initialize(_mp_options);
+
+  free(_mp_options);
+
+  if (!mp) return nullptr;
+
+  // the quotes keep the spaces of an absolute path
+  std::string commandBytes = "MPGUI:=1;input mpguifont.mp;input \"" + fontSource + "\";";
+
+  int status = mp_execute(mp, (char*)commandBytes.c_str(), commandBytes.size());
+  if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+    mp_run_data* results = mp_rundata(mp);
+    std::cout << "Could not load " << fontSource << " in the MetaPost pool\n" << results->term_out.data << '\n';
+    mp_finish(mp);
+    return nullptr;
+  }
+
+  return mp;
+}
+
+MpInstancePool::Lease MpInstancePool::acquire() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (instances.empty()) {
+    throw "MetaPost pool is empty";
+  }
+
+  released.wait(lock, [this] { return !available.empty(); });
+
+  MP mp = available.back();
+  available.pop_back();
+
+  return Lease{ this, mp };
+}
+
+void MpInstancePool::release(MP mp) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    available.push_back(mp);
+  }
+  released.notify_one();
+}
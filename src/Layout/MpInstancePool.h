@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+typedef struct MP_instance* MP;
+
+/*
+  Independent MetaPost instances loaded with the same font sources.
+  A MetaPost instance is not thread safe so each worker leases its own instance.
+*/
+class MpInstancePool {
+public:
+
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(MpInstancePool* pool, MP mp) : pool{ pool }, mp{ mp } {}
+    Lease(Lease&& other) noexcept : pool{ other.pool }, mp{ other.mp } {
+      other.pool = nullptr;
+      other.mp = nullptr;
+    }
+    Lease& operator=(Lease&& other) noexcept {
+      if (this != &other) {
+        reset();
+        pool = other.pool;
+        mp = other.mp;
+        other.pool = nullptr;
+        other.mp = nullptr;
+      }
+      return *this;
+    }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    ~Lease() { reset(); }
+
+    MP instance() const { return mp; }
+
+    void reset() {
+      if (pool != nullptr && mp != nullptr) {
+        pool->release(mp);
+      }
+      pool = nullptr;
+      mp = nullptr;
+    }
+
+  private:
+    MpInstancePool* pool = nullptr;
+    MP mp = nullptr;
+  };
+
+  // fontSource is the path of the MetaPost file input after mpguifont.mp, it is read from disk so it must be saved
+  // finishing is called with each instance before it is finished so the data kept per instance can be dropped
+  MpInstancePool(int size, std::string fontSource, std::function<void(MP)> finishing = nullptr);
+  ~MpInstancePool();
+
+  Lease acquire();
+
+  int size() const { return (int)instances.size(); }
+
+private:
+  static MP createInstance(const std::string& fontSource);
+  void release(MP mp);
+
+  std::vector<MP> instances;
+  std::vector<MP> available;
+  std::function<void(MP)> finishing;
+  std::mutex mutex;
+  std::condition_variable released;
+};
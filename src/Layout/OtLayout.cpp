@@ -43,15 +43,27 @@
 #include "automedina/automedina.h"
 #include "QByteArrayOperator.h"
 #include "GlyphVis.h"
+#include "AlternateCache.h"
+#include "MpInstancePool.h"
+#include "AlternateLruCache.h"
+#include "GlyphInterpolator.h"
+#include "ShapingContext.h"
+#include "PageShaper.h"
+#include "GlyphMetricsCache.h"
+#include "ShapingSession.h"
+#include "TableBlobStore.h"
+#include "ShapedRunCache.h"
 #include "FeaParser/driver.h"
 #include "FeaParser/feaast.h"
 #include "qiodevice.h"
 //#include "hb-ot-layout-gsubgpos.hh"
 
 #include "qregularexpression.h"
+#include <QCryptographicHash>
 
 #include "qurantext/quran.h"
 #include <limits>
+#include <unordered_set>
 
 #include <QtCore/qmath.h>
 #include <fstream>
@@ -95,59 +107,57 @@ static hb_blob_t* harfbuzzGetTables(hb_face_t* face, hb_tag_t tag, void* userDat
 {
   OtLayout* layout = reinterpret_cast<OtLayout*>(userData);
 
-  QByteArray data;
-  hb_memory_mode_t mode = HB_MEMORY_MODE_READONLY;
+  TableBlobStore::Builder build;
+  quint64 version = layout->glyphTablesVersion;
 
   switch (tag) {
   case HB_OT_TAG_GSUB:
-    data = layout->getGSUB();
+    build = [layout]() { return layout->getGSUB(); };
+    version = layout->layoutTablesVersion;
     break;
   case HB_OT_TAG_GPOS:
-    data = layout->getGPOS();
+    build = [layout]() { return layout->getGPOS(); };
+    version = layout->layoutTablesVersion;
     break;
   case HB_OT_TAG_GDEF:
-    data = layout->getGDEF();
+    build = [layout]() { return layout->getGDEF(); };
+    version = layout->layoutTablesVersion;
+    break;
+  case HB_TAG('J', 'T', 'S', 'T'):
+    build = [layout]() { return layout->JTST(); };
+    version = layout->layoutTablesVersion;
     break;
   case HB_TAG('c', 'm', 'a', 'p'):
-    data = layout->getCmap();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->getCmap(); };
     break;
   case HB_TAG('n', 'a', 'm', 'e'):
-    data = layout->toOpenType->name();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->name(); };
     break;
   case HB_TAG('f', 'v', 'a', 'r'):
-    data = layout->toOpenType->fvar();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->fvar(); };
     break;
   case HB_TAG('H', 'V', 'A', 'R'):
-    data = layout->toOpenType->HVAR();
-    mode = HB_MEMORY_MODE_DUPLICATE;
-    break;
-  case HB_TAG('J', 'T', 'S', 'T'):
-    data = layout->JTST();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->HVAR(); };
     break;
   case  HB_TAG('h', 'm', 't', 'x'):
-    data = layout->toOpenType->hmtx();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->hmtx(); };
     break;
   case  HB_TAG('h', 'h', 'e', 'a'):
-    data = layout->toOpenType->hhea();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->hhea(); };
     break;
   case  HB_TAG('p', 'o', 's', 't'):
-    data = layout->toOpenType->post();
-    mode = HB_MEMORY_MODE_DUPLICATE;
+    build = [layout]() { return layout->toOpenType->post(); };
     break;
+  default:
+    return hb_blob_get_empty();
   }
 
-  return hb_blob_create(data.constData(), data.size(), mode, NULL, NULL);
+  return layout->tableBlobs->reference(tag, version, build);
 
 }
 
 static unsigned int
-getNominalGlyphs(hb_font_t* font HB_UNUSED,
+getNominalGlyphs(hb_font_t* font,
   void* font_data,
   unsigned int count,
   const hb_codepoint_t* first_unicode,
@@ -156,9 +166,7 @@ getNominalGlyphs(hb_font_t* font HB_UNUSED,
   unsigned int glyph_stride,
   void* user_data HB_UNUSED)
 {
-  OtLayout* layoutgg = reinterpret_cast<OtLayout*>(font_data);
-
-  auto ot_face = layoutgg->face;
+  auto ot_face = font->face;
 
   return ot_face->table.cmap->get_nominal_glyphs(count,
     first_unicode, unicode_stride,
@@ -185,9 +193,7 @@ getNominalGlyph(hb_font_t* font,
 
 
       //auto tt = QString(text);
-  OtLayout* layoutg = reinterpret_cast<OtLayout*>(font_data);
-
-  auto ot_face = layoutg->face;
+  auto ot_face = font->face;
 
   return ot_face->table.cmap->get_nominal_glyph(unicode, glyph);
 
@@ -209,30 +215,42 @@ static hb_position_t getGlyphHorizontalAdvance(hb_font_t* hbFont, void* fontData
 {
   OtLayout* layout = reinterpret_cast<OtLayout*>(fontData);
 
-  if (!layout->glyphNamePerCode.contains(glyph)) {
+  auto entry = layout->glyphEntry(glyph);
+
+  if (entry == nullptr) {
     //std::cout << "Glyph " << glyph << " not found" << std::endl;
     return 0;
   }
 
-  if (layout->glyphGlobalClasses[glyph] == OtLayout::MarkGlyph) {
+  if (entry->isMark) {
     return 0;
   }
   else {
-    QString name = layout->glyphNamePerCode[glyph];
+    GlyphVis* pglyph = entry->glyph;
 
-    GlyphVis* pglyph = &layout->glyphs[name];
+    double advance = pglyph->width;
 
     if (lefttatweel != 0 || righttatweel != 0) {
-      GlyphParameters parameters{};
+      auto metricsCache = layout->metricsCache;
 
-      parameters.lefttatweel = lefttatweel;
-      parameters.righttatweel = righttatweel;
+      lefttatweel = metricsCache->quantize(lefttatweel);
+      righttatweel = metricsCache->quantize(righttatweel);
 
-      pglyph = layout->getAlternate(pglyph->charcode, parameters);
-    }
+      GlyphMetricsCache::Key key{ nullptr, (quint16)glyph, 0, GlyphMetricsCache::Kind::Advance, lefttatweel, righttatweel };
 
+      advance = metricsCache->get(key, [&]() {
+        GlyphParameters parameters{};
+
+        parameters.lefttatweel = lefttatweel;
+        parameters.righttatweel = righttatweel;
+
+        GlyphMetricsCache::Value value;
+        value.exists = true;
+        value.x = layout->getAlternate(pglyph->charcode, parameters)->width;
+        return value;
+        }).x;
+    }
 
-    double advance = pglyph->width;
     //return advance; // floatToHarfBuzzPosition(advance);
     int upem = 1000;
     int xscale, yscale;
@@ -255,9 +273,7 @@ hb_ot_get_glyph_h_advances(hb_font_t* font, void* font_data,
   void* user_data HB_UNUSED)
 {
 
-  OtLayout* layout = reinterpret_cast<OtLayout*>(font_data);
-
-  auto ot_face = layout->face;
+  auto ot_face = font->face;
 
   //const hb_ot_face_t* ot_face = (const hb_ot_face_t*)font_data;
   //const OT::hmtx_accelerator_t& hmtx = *ot_face->hmtx;
@@ -338,6 +354,29 @@ static void get_glyph_h_advances_custom(hb_font_t* font, void* font_data,
 
 }
 
+template<typename Compute>
+static std::optional<QPoint> getCachedAnchor(OtLayout* layout, const GlyphMetricsCache::Key& key, Compute compute) {
+
+  auto value = layout->metricsCache->get(key, [&]() {
+    GlyphMetricsCache::Value value;
+    auto anchor = compute();
+    if (anchor) {
+      value.exists = true;
+      value.x = anchor->x();
+      value.y = anchor->y();
+    }
+    return value;
+    });
+
+  std::optional<QPoint> anchor;
+
+  if (value.exists) {
+    anchor = QPoint(value.x, value.y);
+  }
+
+  return anchor;
+}
+
 static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
   hb_cursive_anchor_context_t* context,
   hb_position_t* x,
@@ -353,11 +392,15 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
   if (lookupTable->type == Lookup::cursive) {
     CursiveSubtable* subtableTable = static_cast<CursiveSubtable*>(subtable);
 
-    double lefttatweel = layout->normalToParameter(context->glyph_id, context->lefttatweel, true);
-    double righttatweel = layout->normalToParameter(context->glyph_id, context->righttatweel, false);
+    double lefttatweel = layout->metricsCache->quantize(layout->normalToParameter(context->glyph_id, context->lefttatweel, true));
+    double righttatweel = layout->metricsCache->quantize(layout->normalToParameter(context->glyph_id, context->righttatweel, false));
+
+    quint16 glyph_id = context->glyph_id;
 
     if (context->type == hb_cursive_anchor_context_t::entry) {
-      auto anchor = subtableTable->getEntry(context->glyph_id, lefttatweel, righttatweel);
+      auto anchor = getCachedAnchor(layout, { subtable, glyph_id, 0, GlyphMetricsCache::Kind::Entry, lefttatweel, righttatweel }, [&]() {
+        return subtableTable->getEntry(glyph_id, lefttatweel, righttatweel);
+        });
       if (anchor) {
 
         *x = anchor->x();
@@ -371,7 +414,9 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
       }
     }
     else if (context->type == hb_cursive_anchor_context_t::exit) {
-      auto anchor = subtableTable->getExit(context->glyph_id, lefttatweel, righttatweel);
+      auto anchor = getCachedAnchor(layout, { subtable, glyph_id, 0, GlyphMetricsCache::Kind::Exit, lefttatweel, righttatweel }, [&]() {
+        return subtableTable->getExit(glyph_id, lefttatweel, righttatweel);
+        });
       if (anchor) {
 
         *x = anchor->x();
@@ -390,20 +435,17 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
 
     MarkBaseSubtable* subtableTable = static_cast<MarkBaseSubtable*>(subtable);
 
-    quint16 classIndex = subtableTable->markCodes[context->glyph_id];
+    double lefttatweel = layout->metricsCache->quantize(layout->normalToParameter(context->base_glyph_id, context->lefttatweel, true));
+    double righttatweel = layout->metricsCache->quantize(layout->normalToParameter(context->base_glyph_id, context->righttatweel, false));
 
-    QString className = subtableTable->classNamebyIndex[classIndex];
-
-    double lefttatweel = layout->normalToParameter(context->base_glyph_id, context->lefttatweel, true);
-    double righttatweel = layout->normalToParameter(context->base_glyph_id, context->righttatweel, false);
+    quint16 mark_id = context->glyph_id;
+    quint16 base_id = context->base_glyph_id;
 
     if (context->type == hb_cursive_anchor_context_t::base) {
 
-      QString baseGlyphName = layout->glyphNamePerCode[context->base_glyph_id];
-
-      GlyphVis& curr = layout->glyphs[baseGlyphName];
-
-      auto anchor = subtableTable->getBaseAnchor(context->glyph_id, context->base_glyph_id, lefttatweel, righttatweel);
+      auto anchor = getCachedAnchor(layout, { subtable, mark_id, base_id, GlyphMetricsCache::Kind::BaseAnchor, lefttatweel, righttatweel }, [&]() {
+        return subtableTable->getBaseAnchor(mark_id, base_id, lefttatweel, righttatweel);
+        });
       if (anchor) {
 
         *x = anchor->x();
@@ -418,12 +460,10 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
 
     }
     else if (context->type == hb_cursive_anchor_context_t::mark) {
-      QString markGlyphName = layout->glyphNamePerCode[context->glyph_id];
 
-
-      GlyphVis& curr = layout->glyphs[markGlyphName];
-
-      auto anchor = subtableTable->getMarkAnchor(context->glyph_id, context->base_glyph_id, lefttatweel, righttatweel);
+      auto anchor = getCachedAnchor(layout, { subtable, mark_id, base_id, GlyphMetricsCache::Kind::MarkAnchor, lefttatweel, righttatweel }, [&]() {
+        return subtableTable->getMarkAnchor(mark_id, base_id, lefttatweel, righttatweel);
+        });
       if (anchor) {
 
         *x = anchor->x();
@@ -447,118 +487,117 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
 
 }
 
-static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
-  hb_substitution_context_t* context, void* user_data) {
-
-  OtLayout* layout = reinterpret_cast<OtLayout*>(font_data);
-
-  Lookup* lookupTable = layout->gsublookups.at(context->lookup_index);
-
-  if (lookupTable->name == "markexpansion.l1") {
-    auto buffer = context->buffer;
-    unsigned int glyph_count;
+static hb_bool_t substituteMarkExpansion(OtLayout* layout, hb_font_t* font, Lookup* lookupTable, hb_substitution_context_t* context) {
 
-    hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+  auto buffer = context->buffer;
+  unsigned int glyph_count;
 
-    unsigned int prevIndex = context->curr - 1;
+  hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
 
-    while (prevIndex >= 0 && glyph_info[prevIndex].var1.u16[0] & HB_OT_LAYOUT_GLYPH_PROPS_MARK) prevIndex--;
+  int prevIndex = (int)context->curr - 1;
 
-    if (prevIndex < 0) return false;
+  while (prevIndex >= 0 && glyph_info[prevIndex].var1.u16[0] & HB_OT_LAYOUT_GLYPH_PROPS_MARK) prevIndex--;
 
-    auto& curr_info = glyph_info[context->curr];
-    
-    auto& prev_info = glyph_info[prevIndex];
+  if (prevIndex < 0) return false;
 
-    char			buf[64];    
+  auto& curr_info = glyph_info[context->curr];
 
-    hb_font_get_glyph_name(font, curr_info.codepoint, buf, sizeof(buf));
+  auto& prev_info = glyph_info[prevIndex];
 
-    char			prevName[64];
-    hb_font_get_glyph_name(font, prev_info.codepoint, prevName, sizeof(prevName));
-    if (QString(prevName).contains(".expa")) {
-      curr_info.lefttatweel = 0.1 + 0.9 * prev_info.lefttatweel;
-      
-    }
-    else {
-      curr_info.lefttatweel = prev_info.lefttatweel;
-    }
+  auto prevEntry = layout->glyphEntry(prev_info.codepoint);
 
-    auto& curr_glyph = *layout->getGlyph(curr_info.codepoint);
+  if (prevEntry != nullptr && (prevEntry->flags & OtLayout::GlyphTableEntry::Expanded)) {
+    curr_info.lefttatweel = 0.1 + 0.9 * prev_info.lefttatweel;
+  }
+  else {
+    curr_info.lefttatweel = prev_info.lefttatweel;
+  }
 
-    
+  return true;
+}
 
-  }
-  else if (lookupTable->name.startsWith("expa.")) {
+static hb_bool_t substituteExpansion(OtLayout* layout, hb_font_t* font, Lookup* lookupTable, hb_substitution_context_t* context) {
 
-    auto buffer = context->buffer;
+  auto buffer = context->buffer;
 
-    auto& curr_info = buffer->cur();
+  auto& curr_info = buffer->cur();
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
+  auto& justificationContext = ShapingContext::fromFont(font)->justification;
 
-    layout->justificationContext.GlyphsToExtend.push_back(buffer->idx);
-    layout->justificationContext.Substitutes.push_back(context->substitute);
+  justificationContext.GlyphsToExtend.push_back(buffer->idx);
+  justificationContext.Substitutes.push_back(context->substitute);
 
-    auto subtable = lookupTable->subtables.at(context->subtable_index);
+  auto subtable = lookupTable->subtables.at(context->subtable_index);
 
-    if (lookupTable->type == Lookup::single) {
-      SingleSubtable* subtableTable = static_cast<SingleSubtable*>(subtable);
-      if (subtableTable->format == 10) {
-        SingleSubtableWithExpansion* tatweelSubtable = static_cast<SingleSubtableWithExpansion*>(subtableTable);
-        auto& expa = tatweelSubtable->expansion[curr_info.codepoint];
-        layout->justificationContext.Expansions.insert({ buffer->idx, expa });
-        layout->justificationContext.totalWeight += expa.weight;
-      }
+  if (lookupTable->type == Lookup::single) {
+    SingleSubtable* subtableTable = static_cast<SingleSubtable*>(subtable);
+    if (subtableTable->format == 10) {
+      SingleSubtableWithExpansion* tatweelSubtable = static_cast<SingleSubtableWithExpansion*>(subtableTable);
+      auto expa = tatweelSubtable->expansion.value(curr_info.codepoint);
+      justificationContext.Expansions.insert({ buffer->idx, expa });
+      justificationContext.totalWeight += expa.weight;
     }
+  }
+
+  return false;
+}
 
+static hb_bool_t substituteTest(OtLayout* layout, hb_font_t* font, Lookup* lookupTable, hb_substitution_context_t* context) {
 
+  auto buffer = context->buffer;
 
+  auto& curr_info = buffer->cur();
 
-    return false;
+  auto entry = layout->glyphEntry(curr_info.codepoint);
 
+  if (entry != nullptr && entry->glyph->name == "behshape.medi") {
+    curr_info.lefttatweel = 3;
+    curr_info.righttatweel = 2;
   }
-  else if (lookupTable->name.contains("test")) {
 
-    auto buffer = context->buffer;
+  return true;
+}
+
+static hb_bool_t substituteDefault(OtLayout* layout, hb_font_t* font, Lookup* lookupTable, hb_substitution_context_t* context) {
 
-    auto& curr_info = buffer->cur();
+  auto buffer = context->buffer;
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
+  auto& curr_info = buffer->cur();
 
-    //JustificationContext::GlyphsToExtend.append(buffer->idx);
+  auto subtable = lookupTable->subtables.at(context->subtable_index);
 
-    if (name == "behshape.medi") {
-      curr_info.lefttatweel = 3;
-      curr_info.righttatweel = 2;
+  if (lookupTable->type == Lookup::single) {
+    SingleSubtable* subtableTable = static_cast<SingleSubtable*>(subtable);
+    if (subtableTable->format == 10) {
+      SingleSubtableWithExpansion* tatweelSubtable = static_cast<SingleSubtableWithExpansion*>(subtableTable);
+      auto expa = tatweelSubtable->expansion.value(curr_info.codepoint);
+      curr_info.lefttatweel += expa.MaxLeftTatweel;
+      curr_info.righttatweel += expa.MaxRightTatweel;
     }
-
   }
-  else {
-    auto buffer = context->buffer;
 
-    auto& curr_info = buffer->cur();
+  return true;
+}
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
+typedef hb_bool_t(*SubstitutionFunction)(OtLayout* layout, hb_font_t* font, Lookup* lookupTable, hb_substitution_context_t* context);
 
-    //JustificationContext::GlyphsToExtend.append(buffer->idx);
-    //JustificationContext::Substitutes.append(context->substitute);
+// indexed by Lookup::Callback
+static const SubstitutionFunction substitutionFunctions[] = {
+  substituteDefault,
+  substituteMarkExpansion,
+  substituteExpansion,
+  substituteTest,
+  substituteDefault
+};
 
-    auto subtable = lookupTable->subtables.at(context->subtable_index);
+static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
+  hb_substitution_context_t* context, void* user_data) {
 
-    if (lookupTable->type == Lookup::single) {
-      SingleSubtable* subtableTable = static_cast<SingleSubtable*>(subtable);
-      if (subtableTable->format == 10) {
-        SingleSubtableWithExpansion* tatweelSubtable = static_cast<SingleSubtableWithExpansion*>(subtableTable);
-        auto expa = tatweelSubtable->expansion.value(curr_info.codepoint);
-        //layout->justificationContext.Expansions.insert({ buffer->idx, tatweelSubtable->expansion.value(curr_info.codepoint) });
-        curr_info.lefttatweel += expa.MaxLeftTatweel;
-        curr_info.righttatweel += expa.MaxRightTatweel;
-      }
-    }
-  }
+  OtLayout* layout = reinterpret_cast<OtLayout*>(font_data);
 
-  return true;
+  Lookup* lookupTable = layout->gsublookups.at(context->lookup_index);
+
+  return substitutionFunctions[(int)lookupTable->callback](layout, font, lookupTable, context);
 }
 
 static hb_bool_t apply_lookup(hb_font_t* font, void* font_data,
@@ -575,10 +614,8 @@ static hb_bool_t apply_lookup(hb_font_t* font, void* font_data,
     lookupTable = layout->gposlookups.at(c->lookup_index);
   }
 
-  auto subtable = lookupTable->subtables.at(c->subtable_index);
-
-  if (lookupTable->type == Lookup::fsmgsub || lookupTable->type == Lookup::fsmgpos) {
-    FSMSubtable* subtableTable = static_cast<FSMSubtable*>(subtable);
+  if (lookupTable->callback == Lookup::Callback::Fsm) {
+    FSMSubtable* subtableTable = static_cast<FSMSubtable*>(lookupTable->subtables.at(c->subtable_index));
     layout->executeFSM(*subtableTable, c);
   }
 
@@ -586,15 +623,13 @@ static hb_bool_t apply_lookup(hb_font_t* font, void* font_data,
 
 }
 static hb_bool_t
-hb_ot_get_glyph_name(hb_font_t* font HB_UNUSED,
+hb_ot_get_glyph_name(hb_font_t* font,
   void* font_data,
   hb_codepoint_t glyph,
   char* name, unsigned int size,
   void* user_data HB_UNUSED)
 {
-  OtLayout* layout = reinterpret_cast<OtLayout*>(font_data);
-
-  auto ot_face = layout->face;
+  auto ot_face = font->face;
 
   if (ot_face->table.post->get_glyph_name(glyph, name, size)) return true;
 
@@ -634,6 +669,16 @@ static hb_font_funcs_t* getFontFunctions(hb_font_t* font, bool otVar)
   return harfbuzzCoreTextFontFuncs;
 }
 
+GlyphVis* AnchorCalc::getGlyph(Automedina& y, const QString& name) {
+  auto glyph = y.glyphs.constFind(name);
+  return glyph != y.glyphs.constEnd() ? const_cast<GlyphVis*>(&glyph.value()) : nullptr;
+}
+
+QPoint AnchorCalc::getBaseParameter(MarkBaseSubtable& subtable, const QString& className, const QString& glyphName) {
+  auto markClass = subtable.classes.constFind(className);
+  return markClass != subtable.classes.constEnd() ? markClass->baseparameters.value(glyphName) : QPoint();
+}
+
 QPoint AnchorCalc::getAdjustment(Automedina& y, MarkBaseSubtable& subtable, GlyphVis* curr, QString className, QPoint adjust, double lefttatweel, double righttatweel, GlyphVis** poriginalglyph) {
 
   GlyphVis* originalglyph = curr;
@@ -642,11 +687,14 @@ QPoint AnchorCalc::getAdjustment(Automedina& y, MarkBaseSubtable& subtable, Glyp
 
   if (curr->expanded) {
     if (curr->name != "alternatechar" && (!curr->originalglyph.isEmpty() && (curr->charlt != 0 || curr->charrt != 0))) {
-      adjustoriginal = subtable.classes[className].baseparameters[curr->originalglyph];
+      adjustoriginal = getBaseParameter(subtable, className, curr->originalglyph);
     }
 
-    originalglyph = &y.glyphs[curr->originalglyph];
-    if (curr->leftAnchor) {
+    originalglyph = getGlyph(y, curr->originalglyph);
+    if (originalglyph == nullptr) {
+      originalglyph = curr;
+    }
+    else if (curr->leftAnchor) {
       double xshift = curr->matrix.xpart - originalglyph->matrix.xpart;
       double yshift = curr->matrix.ypart - originalglyph->matrix.ypart;
 
@@ -703,9 +751,9 @@ QPoint AnchorCalc::getAdjustment(Automedina& y, MarkBaseSubtable& subtable, Glyp
 }
 
 GlyphVis* OtLayout::getGlyph(QString name, double lefttatweel, double righttatweel) {
-  GlyphVis* pglyph = &this->glyphs[name];
+  GlyphVis* pglyph = findGlyph(name);
 
-  if (lefttatweel != 0 || righttatweel != 0) {
+  if (pglyph != nullptr && (lefttatweel != 0 || righttatweel != 0)) {
     GlyphParameters parameters{};
 
     parameters.lefttatweel = lefttatweel;
@@ -729,24 +777,58 @@ GlyphVis* OtLayout::getGlyph(int code, double lefttatweel, double righttatweel)
       return getAlternate(code, parameters);
     }
     else {
-      return getGlyph(glyphNamePerCode[code], lefttatweel, righttatweel);
+      return getGlyph(code);
     }
   }
 
   return nullptr;
 }
 
-GlyphVis* OtLayout::getGlyph(int code) {
+void OtLayout::updateGlyphTable() {
 
-  GlyphVis* curr = nullptr;
+  glyphTable.clear();
 
-  if (glyphNamePerCode.contains(code)) {
-    QString baseGlyphName = glyphNamePerCode[code];
+  if (glyphNamePerCode.isEmpty()) return;
+
+  glyphTable.resize(glyphNamePerCode.lastKey() + 1);
+
+  for (auto it = glyphNamePerCode.constBegin(); it != glyphNamePerCode.constEnd(); ++it) {
+    updateGlyphTableEntry(it.key());
+  }
+}
+
+void OtLayout::updateGlyphTableEntry(quint16 code) {
+
+  if (code >= glyphTable.size()) {
+    glyphTable.resize(code + 1);
+  }
+
+  GlyphTableEntry& entry = glyphTable[code];
 
-    curr = &glyphs[baseGlyphName];
+  const QString name = glyphNamePerCode.value(code);
+
+  auto glyph = glyphs.find(name);
+  entry.glyph = glyph != glyphs.end() ? &glyph.value() : nullptr;
+
+  auto limits = expandableGlyphs.find(name);
+  entry.limits = limits != expandableGlyphs.end() ? &limits->second : nullptr;
+
+  entry.gdefClass = glyphGlobalClasses.value(code, (GDEFClasses)0);
+  entry.isMark = entry.gdefClass == MarkGlyph;
+
+  entry.flags = 0;
+  if (name.contains(".expa")) {
+    entry.flags |= GlyphTableEntry::Expanded;
+  }
+}
+
+GlyphVis* OtLayout::getGlyph(int code) {
+
+  if (auto entry = glyphEntry(code)) {
+    return entry->glyph;
   }
 
-  return curr;
+  return findGlyph(glyphNamePerCode.value(code));
 }
 
 QByteArray OtLayout::getGDEF() {
@@ -913,6 +995,7 @@ QByteArray OtLayout::getGSUBorGPOS(bool isgsub, QVector<Lookup*>& lookups, QMap<
         quint16 lookupIndex = lookups.size();
 
         lookupsIndexByName[lookup->name] = lookupIndex;
+        lookup->resolveCallback();
         lookups.append(lookup);
       }
     }
@@ -1132,7 +1215,39 @@ OtLayout::OtLayout(MP mp, bool extended, QObject * parent) :QObject(parent), fsm
 
   automedina = new Automedina(this, mp, extended);
 
-  nuqta();
+  updateGlyphTable();
+
+  alternates = new AlternateLruCache();
+  alternates->setBudget(DefaultAlternatesBudget);
+  metricsCache = new GlyphMetricsCache();
+  session = new ShapingSession(this);
+  tableBlobs = new TableBlobStore();
+  shapedRuns = new ShapedRunCache(this);
+
+  interpolator = new GlyphInterpolator(this, [this](const QString& glyphName, const GlyphParameters& parameters) -> GlyphVis* {
+    std::unique_lock<std::mutex> lock(alternateMutex);
+    std::shared_ptr<MpInstancePool> instancePool = mpInstancePool;
+    MpInstancePool::Lease lease;
+    MP instance = automedina->mp;
+
+    // the masters are generated as the alternates, on a leased instance when a pool exists
+    if (instancePool != nullptr) {
+      lock.unlock();
+      lease = instancePool->acquire();
+      instance = lease.instance();
+    }
+
+    mp_edge_object* edge = automedina->instantiateAlternate(instance, glyphName, AlternatelastCode, parameters);
+
+    if (lease.instance() != nullptr) {
+      lock.lock();
+    }
+
+    if (edge == nullptr) return nullptr;
+    return new GlyphVis{ this, edge, true };
+    });
+
+  alternateCache = new AlternateCache(this, extended);
 
   if (!extended) {
 
@@ -1170,24 +1285,77 @@ OtLayout::OtLayout(MP mp, bool extended, QObject * parent) :QObject(parent), fsm
 
 }
 OtLayout::~OtLayout() {
+  // the pool forgets its instances in automedina
+  mpInstancePool.reset();
   for (auto lookup : lookups) {
     delete lookup;
   }
-  clearAlternates();
-
+  delete interpolator;
+  delete alternates;
+  delete metricsCache;
+  delete session;
+  delete tableBlobs;
+  delete shapedRuns;
+  delete alternateCache;
   delete face;
   delete automedina;
   delete toOpenType;
 }
 
+void OtLayout::createMpInstancePool(int size, std::string fontSource) {
+  auto automedina = this->automedina;
+  auto pool = size > 0 ? std::make_shared<MpInstancePool>(size, fontSource, [automedina](MP mp) { automedina->forgetInstance(mp); }) : nullptr;
+  std::lock_guard<std::mutex> lock(alternateMutex);
+  mpInstancePool = pool;
+}
+
+bool OtLayout::openAlternateCache(const QString& fileName) {
+#ifdef __EMSCRIPTEN__
+  // MEMFS does not outlive the page
+  return false;
+#else
+  std::lock_guard<std::mutex> lock(alternateMutex);
+  return alternateCache->open(fileName);
+#endif
+}
+
+void OtLayout::glyphsChanged() {
+  std::lock_guard<std::mutex> lock(alternateMutex);
+  alternates->clear();
+  // the metrics outlive clearAlternates and the evictions, only a glyph edit changes them
+  metricsCache->clear();
+  alternateCache->discard();
+  interpolator->clear();
+  // the pool instances input the font file, the alternates are generated on the edited instance until a new pool is created
+  mpInstancePool.reset();
+}
+
+OtLayout::PinnedAlternates::PinnedAlternates(OtLayout* layout) : layout{ layout } {
+  std::lock_guard<std::mutex> lock(layout->alternateMutex);
+  ticket = layout->alternates->pin();
+}
+
+OtLayout::PinnedAlternates::~PinnedAlternates() {
+  std::lock_guard<std::mutex> lock(layout->alternateMutex);
+  layout->alternates->unpin(ticket);
+}
+
 void OtLayout::clearAlternates() {
-  for (auto& glyph : alternatePaths) {
-    for (auto& path : glyph.second) {
-      delete path.second;
-    }
-    //glyph.second.clear();
-  }
-  alternatePaths.clear();
+  std::lock_guard<std::mutex> lock(alternateMutex);
+  alternates->clear(AlternateLruCache::Pool::Justification);
+}
+
+void OtLayout::setAlternatesBudget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(alternateMutex);
+  alternates->setBudget(bytes);
+}
+
+void OtLayout::setInterpolationTolerance(double tolerance) {
+  interpolator->setTolerance(tolerance);
+}
+
+void OtLayout::setMetricsQuantization(double step) {
+  metricsCache->setStep(step);
 }
 
 CalcAnchor OtLayout::getanchorCalcFunctions(QString functionName, Subtable * subtable) {
@@ -1371,6 +1539,7 @@ void OtLayout::readJson(const QJsonObject & json)
     delete lookup;
   }
   lookups.clear();
+  metricsCache->clear();
   lookupsIndexByName.clear();
   gsublookups.clear();
   gposlookups.clear();
@@ -1457,6 +1626,8 @@ void OtLayout::readJson(const QJsonObject & json)
     face = nullptr;
   }
 
+  dirty = true;
+
   /*
       for (auto iter = allFeatures.constBegin(); iter != allFeatures.constEnd(); ++iter) {
           std::cout << "feature " << iter.key().toStdString() << " { " << endl;
@@ -1525,6 +1696,7 @@ void OtLayout::readParameters(const QJsonObject & json) {
       }
     }
   }
+  dirty = true;
 }
 void OtLayout::addClass(QString name, QSet<QString> set) {
   if (automedina->classes.contains(name)) {
@@ -1535,22 +1707,48 @@ void OtLayout::addClass(QString name, QSet<QString> set) {
   }
   automedina->classes[name] = set;
 }
-hb_font_t* OtLayout::createFont(int emScale, bool newFace)
-{
-  int upem = 1000;
+hb_face_t* OtLayout::updateFace(bool newFace) {
 
-  if (newFace || face == nullptr) {
+  std::lock_guard<std::mutex> guard(faceMutex);
+
+  // the fonts reference the face, a font created before keeps the previous face
+  if (face == nullptr || (newFace && dirty)) {
     if (face != nullptr) {
       hb_face_destroy(face);
       face = nullptr;
     }
 
-
     face = hb_face_create_for_tables(harfbuzzGetTables, this, 0);
-    hb_face_set_upem(face, upem);
+    hb_face_set_upem(face, 1000);
+
+    layoutTablesVersion++;
+
+    // the layout tables are built once here instead of on each table request of the face
+    for (hb_tag_t tag : { HB_OT_TAG_GDEF, HB_OT_TAG_GSUB, HB_OT_TAG_GPOS }) {
+      hb_blob_destroy(hb_face_reference_table(face, tag));
+    }
+    dirty = false;
   }
 
-  hb_font_t* font = hb_font_create(face);
+  return hb_face_reference(face);
+}
+
+hb_font_t* OtLayout::createFont(int emScale, bool newFace)
+{
+  int upem = 1000;
+
+  hb_font_t* font;
+  hb_font_funcs_t* funcs;
+
+  hb_face_t* currentFace = updateFace(newFace);
+  font = hb_font_create(currentFace);
+  hb_face_destroy(currentFace);
+
+  {
+    std::lock_guard<std::mutex> guard(faceMutex);
+    // the font functions are created on the first call
+    funcs = getFontFunctions(font, useNormAxisValues);
+  }
   hb_font_set_ppem(font, upem, upem);
   const int scale = emScale * upem; // // (1 << OtLayout::SCALEBY) * static_cast<int>(size);
   hb_font_set_scale(font, scale, scale);
@@ -1564,7 +1762,11 @@ hb_font_t* OtLayout::createFont(int emScale, bool newFace)
   hb_font_set_funcs(subfont, ffunctions, font_data, destroy);
   hb_font_funcs_destroy(ffunctions);*/
 
-  hb_font_set_funcs(subfont, getFontFunctions(font, useNormAxisValues), this, 0);
+  hb_font_set_funcs(subfont, funcs, this, 0);
+
+  ShapingContext* context = new ShapingContext();
+  context->applyJustification = applyJustification;
+  ShapingContext::attach(subfont, context);
 
 
   return subfont;
@@ -1630,7 +1832,11 @@ QSet<QString> OtLayout::classtoGlyphName(QString className) {
 
 double OtLayout::nuqta() {
   if (_nuqta == -1) {
-    _nuqta = getNumericVariable("nuqta");
+    // the pages may be justified concurrently, the main instance is guarded as in getAlternate
+    std::lock_guard<std::mutex> lock(alternateMutex);
+    if (_nuqta == -1) {
+      _nuqta = getNumericVariable("nuqta");
+    }
   }
 
   return _nuqta;
@@ -1700,6 +1906,7 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
     qDebug() << QString("Changing single adjust anchor %1.%2.%3 :").arg(lookupTable->name, subtable->name, glyphName) << newvalue.xPlacement << newvalue.yPlacement << newvalue.xAdvance;
 
     subtableTable->isDirty = true;
+    dirty = true;
 
     emit parameterChanged();
   }
@@ -1744,6 +1951,7 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
       qDebug() << QString("Changing mark anchor %1::%2::%3::%4 : (%5,%6)").arg(lookupTable->name, subtable->name, className, markGlyphName, QString::number(newvalue.x()), QString::number(newvalue.y()));
     }
     subtableTable->isDirty = true;
+    dirty = true;
 
 
 
@@ -1751,6 +1959,8 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
 
 
 
+    metricsCache->clear();
+
     emit parameterChanged();
 
   }
@@ -1787,6 +1997,9 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
     //}
 
     subtableTable->isDirty = true;
+    dirty = true;
+
+    metricsCache->clear();
 
     emit parameterChanged();
 
@@ -1795,8 +2008,150 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
 }
 #endif
 
+std::vector<double> OtLayout::getJustificationCapacities(const QString& feature, bool stretch) {
+
+  std::vector<double> capacities;
+
+  // the expansions are in the lookups of the feature and in the lookups they reference
+  QVector<Lookup*> lookups;
+  QSet<Lookup*> visited;
+
+  for (auto lookup_index : allGsubFeatures.value(feature)) {
+    if (lookup_index < gsublookups.size()) {
+      lookups.append(gsublookups[lookup_index]);
+    }
+  }
+
+  while (!lookups.isEmpty()) {
+    Lookup* lookup = lookups.takeLast();
+    if (visited.contains(lookup)) continue;
+    visited.insert(lookup);
+
+    for (auto subtable : lookup->subtables) {
+      if (auto chaining = dynamic_cast<ChainingSubtable*>(subtable)) {
+        for (auto& record : chaining->compiledRule.lookupRecords) {
+          int index = gsublookupsIndexByName.value(record.lookupName, -1);
+          if (index != -1) {
+            lookups.append(gsublookups[index]);
+          }
+        }
+      }
+      else if (auto single = dynamic_cast<SingleSubtableWithExpansion*>(subtable)) {
+        for (auto it = single->expansion.constBegin(); it != single->expansion.constEnd(); ++it) {
+
+          GlyphExpansion expa = it.value();
+
+          const GlyphTableEntry* entry = useNormAxisValues ? nullptr : glyphEntry(single->subst.value(it.key(), it.key()));
+          const ValueLimits* limits = entry != nullptr ? entry->limits : nullptr;
+
+          double capacity;
+          if (stretch) {
+            double left = limits ? std::min<double>(expa.MaxLeftTatweel, limits->maxLeft) : expa.MaxLeftTatweel;
+            double right = limits ? std::min<double>(expa.MaxRightTatweel, limits->maxRight) : expa.MaxRightTatweel;
+            capacity = std::max(left, 0.0) + std::max(right, 0.0);
+          }
+          else {
+            double left = limits ? std::max<double>(expa.MinLeftTatweel, limits->minLeft) : expa.MinLeftTatweel;
+            double right = limits ? std::max<double>(expa.MinRightTatweel, limits->minRight) : expa.MinRightTatweel;
+            capacity = -(std::min(left, 0.0) + std::min(right, 0.0));
+          }
+
+          if (it.key() >= capacities.size()) {
+            capacities.resize(it.key() + 1, 0.0);
+          }
+          capacities[it.key()] = std::max(capacities[it.key()], capacity);
+        }
+      }
+    }
+  }
+
+  return capacities;
+}
+
+// a ligature group of a justification lookup, the widths are counted in the direction of the justification
+struct JustificationGroup {
+  int first = 0;
+  int last = 0;
+  int weight = 0;
+  // width added by the substitution of the group
+  double cost = 0;
+  // maximum width added by the tatweel of the group
+  double capacity = 0;
+  // units from which the group is applied and from which its tatweel is at the capacity
+  double activation = 0;
+  double saturation = 0;
+  bool applied = false;
+};
+
+/*
+  Returns the width per weight unit so that the groups fill the width in one pass.
+  A group receiving weight * unit pays its substitution first then its tatweel up to the capacity,
+  a group whose substitution does not fit in the remaining width is not applied.
+*/
+static double solveJustification(std::vector<JustificationGroup>& groups, double width) {
+
+  struct Event {
+    double unit;
+    int group;
+    bool saturation;
+  };
+
+  std::vector<Event> events;
+  events.reserve(groups.size() * 2);
+
+  for (int g = 0; g < groups.size(); g++) {
+    auto& group = groups[g];
+    group.applied = false;
+    group.activation = std::max(group.cost, 0.0) / group.weight;
+    group.saturation = std::max(group.activation, (group.cost + group.capacity) / group.weight);
+    events.push_back({ group.activation, g, false });
+    if (group.saturation > group.activation) {
+      events.push_back({ group.saturation, g, true });
+    }
+  }
+
+  std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.unit < b.unit; });
+
+  // the filled width is slope * unit + fixed
+  double slope = 0;
+  double fixed = 0;
+
+  for (auto& event : events) {
+    if (slope > 0 && slope * event.unit + fixed >= width) {
+      return (width - fixed) / slope;
+    }
+
+    auto& group = groups[event.group];
+    bool linear = group.saturation > group.activation;
+
+    if (!event.saturation) {
+      double added = linear ? group.weight * event.unit : group.cost + group.capacity;
+      if (slope * event.unit + fixed + added > width) continue;
+      group.applied = true;
+      if (linear) {
+        slope += group.weight;
+      }
+      else {
+        fixed += added;
+      }
+    }
+    else if (group.applied) {
+      slope -= group.weight;
+      fixed += group.cost + group.capacity;
+    }
+  }
+
+  if (slope > 0) {
+    return (width - fixed) / slope;
+  }
+
+  return events.empty() ? 0.0 : events.back().unit;
+}
+
 void OtLayout::applyJustFeature(hb_buffer_t * buffer, bool& needgpos, double& diff, QString feature, hb_font_t * shapefont, double nuqta, int emScale) {
 
+  auto& justificationContext = ShapingContext::fromFont(shapefont)->justification;
+
   if (!this->allGsubFeatures.contains(feature))
     return;
 
@@ -1806,28 +2161,20 @@ void OtLayout::applyJustFeature(hb_buffer_t * buffer, bool& needgpos, double& di
   uint glyph_count;
 
   hb_buffer_t* copy_buffer = nullptr;
-  copy_buffer = hb_buffer_create();
+  copy_buffer = session->acquireBuffer();
   hb_buffer_append(copy_buffer, buffer, 0, -1);
 
   hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(copy_buffer, &glyph_count);
 
   OT::hb_ot_apply_context_t c(table_index, shapefont, buffer);
   c.set_recurse_func(OT::SubstLookup::apply_recurse_func);
-  auto list = this->allGsubFeatures[feature].values();
+  auto list = this->allGsubFeatures.value(feature).values();
   std::sort(list.begin(), list.end());
 
   bool stretch = diff > 0;
+  double sign = stretch ? 1.0 : -1.0;
 
-  /*
-  for (auto& table : tables) {
-    if (table->name == "just") {
-      for (auto& subtable : table->subtables) {
-        if (auto dd = dynamic_cast<FSMSubtable*>(subtable)) {
-          fsmDriver.executeFSM(*dd, buffer);
-        }
-      }
-    }
-  }*/
+  std::vector<JustificationGroup> groups;
 
   for (auto lookup_index : list) {
 
@@ -1841,572 +2188,139 @@ void OtLayout::applyJustFeature(hb_buffer_t * buffer, bool& needgpos, double& di
     needgpos = true;
     justificationContext.clear();
 
-    /*
-    OT::JustificationContext justContext{ shapefont };
-    buffer->justContext = &justContext;*/
-
-
     hb_ot_layout_substitute_lookup(&c,
       shapefont->face->table.GSUB->table->get_lookup(lookup_index),
       shapefont->face->table.GSUB->accels[lookup_index]);
 
     hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
 
-    int totalWeight = justificationContext.totalWeight;
-
-    bool remaining = true;
-
-    double remainingWidth = -1;
+    if (justificationContext.totalWeight == 0) continue;
 
-    while (totalWeight != 0 && remaining && remainingWidth != 0.0) {
+    // gathers the groups with their substitution width and their tatweel limits
 
-      double expaUnit = diff / totalWeight;
-      if (expaUnit == 0.0) {
-        diff = 0.0;
-        break;;
-      }
-
-      totalWeight = 0;
+    groups.clear();
 
-      QMap<int, GlyphExpansion > affectedIndexes;
+    bool insideGroup = false;
+    hb_position_t oldWidth = 0;
+    hb_position_t newWidth = 0;
+    JustificationGroup group;
 
-      bool insideGroup = false;
-      hb_position_t oldWidth = 0;
-      hb_position_t newWidth = 0;
-      GlyphExpansion groupExpa{};
-      groupExpa.weight = 0;
-      QVector<int> group;
-      remaining = false;
-      remainingWidth = 0.0;
+    for (int i = 0; i < justificationContext.GlyphsToExtend.size(); i++) {
 
+      int index = justificationContext.GlyphsToExtend[i];
+      unsigned int substitute = justificationContext.Substitutes[i];
 
-      for (int i = 0; i < justificationContext.GlyphsToExtend.size(); i++) {
-
-        int index = justificationContext.GlyphsToExtend[i];
-        GlyphVis& substitute = this->glyphs[this->glyphNamePerCode[justificationContext.Substitutes[i]]];
+      GlyphExpansion& expa = justificationContext.Expansions[index];
 
-        GlyphExpansion& expa = justificationContext.Expansions[index];
+      if (expa.stretchIsAbsolute) {
+        expa.MaxLeftTatweel = expa.MaxLeftTatweel - glyph_info[index].lefttatweel;
+        expa.MaxRightTatweel = expa.MaxRightTatweel - glyph_info[index].righttatweel;
+        expa.stretchIsAbsolute = false;
+      }
 
-        if (expa.stretchIsAbsolute) {
-          expa.MaxLeftTatweel = expa.MaxLeftTatweel - glyph_info[index].lefttatweel;
-          expa.MaxRightTatweel = expa.MaxRightTatweel - glyph_info[index].righttatweel;
-          expa.stretchIsAbsolute = false;
-        }
+      if (expa.shrinkIsAbsolute) {
+        expa.MinLeftTatweel = expa.MinLeftTatweel - glyph_info[index].lefttatweel;
+        expa.MinRightTatweel = expa.MinRightTatweel - glyph_info[index].righttatweel;
+        expa.shrinkIsAbsolute = false;
+      }
 
-        if (expa.shrinkIsAbsolute) {
-          expa.MinLeftTatweel = expa.MinLeftTatweel - glyph_info[index].lefttatweel;
-          expa.MinRightTatweel = expa.MinRightTatweel - glyph_info[index].righttatweel;
-          expa.shrinkIsAbsolute = false;
-        }
+      // the tatweel in parameter units cannot exceed the limits of the glyph
+      const GlyphTableEntry* entry = useNormAxisValues ? nullptr : glyphEntry(substitute);
+      const ValueLimits* limits = entry != nullptr ? entry->limits : nullptr;
 
-        group.append(i);
-        oldWidth += glyph_pos[index].x_advance;
-        if (glyph_info[index].codepoint == justificationContext.Substitutes[i]) {
-          newWidth += glyph_pos[index].x_advance;
+      if (stretch) {
+        if (limits) {
+          expa.MaxLeftTatweel = std::min<double>(expa.MaxLeftTatweel, limits->maxLeft - glyph_info[index].lefttatweel);
+          expa.MaxRightTatweel = std::min<double>(expa.MaxRightTatweel, limits->maxRight - glyph_info[index].righttatweel);
         }
-        else {
-          newWidth += getGlyphHorizontalAdvance(shapefont, this, justificationContext.Substitutes[i], glyph_pos[index].lefttatweel, glyph_pos[index].righttatweel, nullptr); // substitute.width* emScale;
+        expa.MaxLeftTatweel = expa.MaxLeftTatweel > 0 ? expa.MaxLeftTatweel : 0;
+        expa.MaxRightTatweel = expa.MaxRightTatweel > 0 ? expa.MaxRightTatweel : 0;
+        group.capacity += expa.MaxLeftTatweel + expa.MaxRightTatweel;
+      }
+      else {
+        if (limits) {
+          expa.MinLeftTatweel = std::max<double>(expa.MinLeftTatweel, limits->minLeft - glyph_info[index].lefttatweel);
+          expa.MinRightTatweel = std::max<double>(expa.MinRightTatweel, limits->minRight - glyph_info[index].righttatweel);
         }
+        expa.MinLeftTatweel = expa.MinLeftTatweel < 0 ? expa.MinLeftTatweel : 0;
+        expa.MinRightTatweel = expa.MinRightTatweel < 0 ? expa.MinRightTatweel : 0;
+        group.capacity -= expa.MinLeftTatweel + expa.MinRightTatweel;
+      }
 
-        groupExpa.weight += expa.weight;
-        groupExpa.MinLeftTatweel += expa.MinLeftTatweel;
-        groupExpa.MaxLeftTatweel += expa.MaxLeftTatweel;
-        groupExpa.MinRightTatweel += expa.MinRightTatweel;
-        groupExpa.MaxRightTatweel += expa.MaxRightTatweel;
-
-
-        if (expa.startEndLig == StartEndLig::Start) {
-          insideGroup = true;
-          continue;
-        }
-        else if (insideGroup && expa.startEndLig != StartEndLig::End && expa.startEndLig != StartEndLig::EndKashida) {
-          continue;
-        }
+      oldWidth += glyph_pos[index].x_advance;
+      if (glyph_info[index].codepoint == substitute) {
+        newWidth += glyph_pos[index].x_advance;
+      }
+      else {
+        newWidth += getGlyphHorizontalAdvance(shapefont, this, substitute, glyph_pos[index].lefttatweel, glyph_pos[index].righttatweel, nullptr);
+      }
 
-        if (groupExpa.weight == 0) goto next;
+      group.weight += expa.weight;
 
-        int widthDiff = newWidth - oldWidth;
+      if (expa.startEndLig == StartEndLig::Start) {
+        insideGroup = true;
+        continue;
+      }
+      else if (insideGroup && expa.startEndLig != StartEndLig::End && expa.startEndLig != StartEndLig::EndKashida) {
+        continue;
+      }
 
-        auto tatweel = expaUnit * groupExpa.weight + remainingWidth;
+      if (group.weight > 0) {
+        group.last = i;
+        group.cost = sign * (newWidth - oldWidth);
+        group.capacity *= nuqta;
+        groups.push_back(group);
+      }
 
-        if ((stretch && widthDiff > tatweel) || (!stretch && widthDiff < tatweel)) {
-          totalWeight += groupExpa.weight;
-          remainingWidth = tatweel;
-        }
-        else {
+      insideGroup = false;
+      oldWidth = 0;
+      newWidth = 0;
+      group = {};
+      group.first = i + 1;
+    }
 
-          diff -= widthDiff;
-          tatweel -= widthDiff;
+    // distributes the width in one pass
 
-          for (int i : group) {
+    double unit = solveJustification(groups, sign * diff);
 
-            int index = justificationContext.GlyphsToExtend[i];
-            GlyphExpansion& expa = justificationContext.Expansions[index];
+    for (auto& group : groups) {
 
-            glyph_info[index].codepoint = justificationContext.Substitutes[i];
+      if (!group.applied) continue;
 
-            if (stretch) {
-              expa.MaxLeftTatweel = expa.MaxLeftTatweel > 0 ? expa.MaxLeftTatweel : 0;
-              expa.MaxRightTatweel = expa.MaxRightTatweel > 0 ? expa.MaxRightTatweel : 0;
+      double tatweel = std::min(std::max(unit * group.weight - group.cost, 0.0), group.capacity);
+      double ratio = group.capacity > 0 ? tatweel / group.capacity : 0.0;
 
-              auto maxTatweel = expa.MaxLeftTatweel + expa.MaxRightTatweel;
-              if (maxTatweel != 0) {
-                auto maxStretch = maxTatweel * nuqta;
+      for (int i = group.first; i <= group.last; i++) {
 
-                if (tatweel > maxStretch) {
-                  remainingWidth = tatweel - maxStretch;
-                  tatweel = maxStretch;
-                }
-                else {
-                  remainingWidth = 0;
-                }
+        int index = justificationContext.GlyphsToExtend[i];
+        GlyphExpansion& expa = justificationContext.Expansions[index];
 
-                double leftTatweel = (tatweel * (expa.MaxLeftTatweel / maxTatweel)) / nuqta;
-                double rightTatweel = (tatweel * (expa.MaxRightTatweel / maxTatweel)) / nuqta;
+        glyph_info[index].codepoint = justificationContext.Substitutes[i];
 
-                glyph_info[index].lefttatweel += leftTatweel;
-                glyph_info[index].righttatweel += rightTatweel;
-
-                diff -= tatweel;
-
-                if (maxStretch > tatweel) {
-                  expa.MaxLeftTatweel -= leftTatweel;
-                  expa.MaxRightTatweel -= rightTatweel;
-                  remaining = true;
-                  totalWeight += expa.weight;
-                }
-                else {
-                  expa.weight = 0;
-                }
-              }
-              else {
-                expa.weight = 0;
-              }
-            }
-            else {
-              expa.MinLeftTatweel = expa.MinLeftTatweel < 0 ? expa.MinLeftTatweel : 0;
-              expa.MinRightTatweel = expa.MinRightTatweel < 0 ? expa.MinRightTatweel : 0;
-
-              auto MinTatweel = expa.MinLeftTatweel + expa.MinRightTatweel;
-
-              if (MinTatweel != 0) {
-                auto minShrink = MinTatweel * nuqta;
-
-                if (tatweel < minShrink) {
-                  remainingWidth = tatweel - minShrink;
-                  tatweel = minShrink;
-                }
-                else {
-                  remainingWidth = 0;
-                }
-
-                double leftTatweel = (tatweel * (expa.MinLeftTatweel / MinTatweel)) / nuqta;
-                double rightTatweel = (tatweel * (expa.MinRightTatweel / MinTatweel)) / nuqta;
-
-                glyph_info[index].lefttatweel += leftTatweel;
-                glyph_info[index].righttatweel += rightTatweel;
-
-                diff -= tatweel;
-
-                if (tatweel > minShrink) {
-                  expa.MinLeftTatweel -= leftTatweel;
-                  expa.MinRightTatweel -= rightTatweel;
-                  remaining = true;
-                  totalWeight += expa.weight;
-                }
-                else {
-                  expa.weight = 0;
-                }
-              }
-              else {
-                expa.weight = 0;
-              }
-            }
-          }
+        if (stretch) {
+          glyph_info[index].lefttatweel += ratio * expa.MaxLeftTatweel;
+          glyph_info[index].righttatweel += ratio * expa.MaxRightTatweel;
         }
-
-      next:
-        insideGroup = false;
-        oldWidth = 0.0;
-        newWidth = 0.0;
-        groupExpa = {};
-        groupExpa.weight = 0;
-        group.clear();
-      }
-    }
-  }
-  buffer->reverse();
-  if (copy_buffer)
-    hb_buffer_destroy(copy_buffer);
-
-}
-
-void OtLayout::applyJustFeature_old(hb_buffer_t * buffer, bool& needgpos, double& diff, QString feature, hb_font_t * shapefont, double nuqta, int emScale) {
-
-  if (!this->allGsubFeatures.contains(feature))
-    return;
-
-  const unsigned int table_index = 0u;
-  buffer->reverse();
-
-  uint glyph_count;
-
-  hb_buffer_t* copy_buffer = nullptr;
-  copy_buffer = hb_buffer_create();
-  hb_buffer_append(copy_buffer, buffer, 0, -1);
-
-  hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(copy_buffer, &glyph_count);
-
-  OT::hb_ot_apply_context_t c(table_index, shapefont, buffer);
-  c.set_recurse_func(OT::SubstLookup::apply_recurse_func);
-  auto list = this->allGsubFeatures[feature].values();
-  std::sort(list.begin(), list.end());
-  bool stretch = diff > 0;
-
-  /*
-  for (auto& table : tables) {
-    if (table->name == "just") {
-      for (auto& subtable : table->subtables) {
-        if (auto dd = dynamic_cast<FSMSubtable*>(subtable)) {
-          fsmDriver.executeFSM(*dd, buffer);
+        else {
+          glyph_info[index].lefttatweel += ratio * expa.MinLeftTatweel;
+          glyph_info[index].righttatweel += ratio * expa.MinRightTatweel;
         }
       }
-    }
-  }*/
-
-  for (auto lookup_index : list) {
-    if ((stretch && diff > 0) || (!stretch && diff < 0)) {
-      c.set_lookup_index(lookup_index);
-      c.set_lookup_mask(2);
-      c.set_auto_zwj(1);
-      c.set_auto_zwnj(1);
-
-      needgpos = true;
-      justificationContext.clear();
-
-      hb_ot_layout_substitute_lookup(&c,
-        shapefont->face->table.GSUB->table->get_lookup(lookup_index),
-        shapefont->face->table.GSUB->accels[lookup_index]);
-
-      hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
-
-      if (justificationContext.GlyphsToExtend.size() != 0) {
-
-        //double tatweel = diff / JustificationContext::GlyphsToExtend.count() / nuqta;
-
-        QMap<int, GlyphExpansion > affectedIndexes;
-
-        bool insideGroup = false;
-        hb_position_t oldWidth = 0;
-        hb_position_t newWidth = 0;
-        QVector<int> group;
-
-        for (int i = 0; i < justificationContext.GlyphsToExtend.size(); i++) {
-
-          int index = justificationContext.GlyphsToExtend[i]; // glyph_count - 1 - JustificationContext::GlyphsToExtend[i];
-          GlyphVis& substitute = this->glyphs[this->glyphNamePerCode[justificationContext.Substitutes[i]]];
-
-          GlyphExpansion& expa = justificationContext.Expansions[index];
-
-          group.append(i);
-          oldWidth += glyph_pos[index].x_advance;
-          if (glyph_info[index].codepoint == justificationContext.Substitutes[i]) {
-            newWidth += glyph_pos[index].x_advance;
-          }
-          else {
-            double leftTatweel = glyph_pos[index].lefttatweel + expa.MinLeftTatweel > 0 ? expa.MinLeftTatweel : 0;
-            double rightTatweel = glyph_pos[index].righttatweel + expa.MinRightTatweel > 0 ? expa.MinRightTatweel : 0;
-            newWidth += getGlyphHorizontalAdvance(shapefont, this, justificationContext.Substitutes[i], leftTatweel, rightTatweel, nullptr); // substitute.width* emScale;
-          }
-
-
-          if (expa.startEndLig == StartEndLig::Start) {
-            insideGroup = true;
-            continue;
-          }
-          else if (insideGroup && expa.startEndLig != StartEndLig::End && expa.startEndLig != StartEndLig::EndKashida) {
-            continue;
-          }
-
-          auto expansion = newWidth - oldWidth;
-
-          if ((stretch && expansion <= diff && expansion >= 0) || (!stretch && expansion >= diff && expansion <= 0)) {
-
-            diff -= expansion;
-
-            for (int i : group) {
-
-              int index = justificationContext.GlyphsToExtend[i];
-              GlyphExpansion& expa = justificationContext.Expansions[index];
-
-              if (glyph_info[index].codepoint == justificationContext.Substitutes[i]) {
-
-                expa.MaxLeftTatweel = expa.MaxLeftTatweel - glyph_info[index].lefttatweel;
-                expa.MaxRightTatweel = expa.MaxRightTatweel - glyph_info[index].righttatweel;
-
-                if (stretch && expa.MaxLeftTatweel <= 0 && expa.MaxRightTatweel <= 0
-                  || !stretch && expa.MinLeftTatweel >= 0 && expa.MinRightTatweel >= 0)
-                  continue;
-
-                affectedIndexes.insert(i, expa);
-              }
-              else {
-                //GlyphVis& glyph = this->glyphs[this->glyphNamePerCode[glyph_info[index].codepoint]];
-                //GlyphVis& substitute = this->glyphs[this->glyphNamePerCode[JustificationContext::Substitutes[i]]];
-
-                //auto minStretch = (substitute.width - glyph.width) * emScale; // +JustificationContext::Expansions[index].MinLeftTatweel * nuqta;
-
-                glyph_info[index].codepoint = justificationContext.Substitutes[i];
-                if (expa.MinLeftTatweel > 0) {
-                  glyph_info[index].lefttatweel += expa.MinLeftTatweel;
-                  expa.MinLeftTatweel = 0;
-                }
-
-                if (expa.MinRightTatweel > 0) {
-                  glyph_info[index].righttatweel += expa.MinRightTatweel;
-                  expa.MinRightTatweel = 0;
-                }
-
-                if (stretch) {
-
-                  if (expa.MaxLeftTatweel > 0 || expa.MaxRightTatweel > 0) {
-                    affectedIndexes.insert(i, expa);
-                  }
-                }
-                else if (!stretch) {
-
-                  if (expa.MinLeftTatweel < 0 || expa.MinRightTatweel < 0) {
-                    affectedIndexes.insert(i, expa);
-                  }
-                }
-              }
-            }
-
-          }
-
-          insideGroup = false;
-          oldWidth = 0.0;
-          newWidth = 0.0;
-          group.clear();
-        }
-
-        while (affectedIndexes.size() != 0) {
-          double meanTatweel = diff / (affectedIndexes.size());
-
-          if (meanTatweel == 0.0) break;
-
-          QMap<int, GlyphExpansion >::iterator i;
-          QMap<int, GlyphExpansion > newaffectedIndexes;
-          for (i = affectedIndexes.begin(); i != affectedIndexes.end(); ++i) {
-
-            int index = justificationContext.GlyphsToExtend[i.key()]; // glyph_count - 1 - JustificationContext::GlyphsToExtend[i];
-
-            auto expa = i.value();
-
-            if (stretch) {
-              expa.MaxLeftTatweel = expa.MaxLeftTatweel > 0 ? expa.MaxLeftTatweel : 0;
-              expa.MaxRightTatweel = expa.MaxRightTatweel > 0 ? expa.MaxRightTatweel : 0;
-
-              auto MaxTatweel = expa.MaxLeftTatweel + expa.MaxRightTatweel;
-              auto maxStretch = MaxTatweel * nuqta;
-
-
-              auto tatweel = meanTatweel;
-
-              if (meanTatweel > maxStretch) {
-                tatweel = maxStretch;
-              }
-
-              diff -= tatweel;
-
-              double leftTatweel = (tatweel * (expa.MaxLeftTatweel / MaxTatweel)) / nuqta;
-              double rightTatweel = (tatweel * (expa.MaxRightTatweel / MaxTatweel)) / nuqta;
-
-              glyph_info[index].lefttatweel += leftTatweel;
-              glyph_info[index].righttatweel += rightTatweel;
-
-              if (meanTatweel < maxStretch && diff > 0) {
-                expa.MaxLeftTatweel -= leftTatweel;
-                expa.MaxRightTatweel -= rightTatweel;
-                newaffectedIndexes.insert(i.key(), expa);
-              }
-
-            }
-            else {
-              expa.MinLeftTatweel = expa.MinLeftTatweel < 0 ? expa.MinLeftTatweel : 0;
-              expa.MinRightTatweel = expa.MinRightTatweel < 0 ? expa.MinRightTatweel : 0;
-
-              auto MinTatweel = expa.MinLeftTatweel + expa.MinRightTatweel;
-              auto minShrink = MinTatweel * nuqta;
-
 
-              auto tatweel = meanTatweel;
-
-              if (meanTatweel < minShrink) {
-                tatweel = minShrink;
-              }
-
-              diff -= tatweel;
-
-              double leftTatweel = (tatweel * (expa.MinLeftTatweel / MinTatweel)) / nuqta;
-              double rightTatweel = (tatweel * (expa.MinRightTatweel / MinTatweel)) / nuqta;
-
-              glyph_info[index].lefttatweel += leftTatweel;
-              glyph_info[index].righttatweel += rightTatweel;
-
-              if (meanTatweel > minShrink && diff < 0) {
-                expa.MinLeftTatweel -= leftTatweel;
-                expa.MinRightTatweel -= rightTatweel;
-                newaffectedIndexes.insert(i.key(), expa);
-              }
-            }
-          }
-          affectedIndexes = newaffectedIndexes;
-        }
-      }
-    }
-    else {
-      continue;
+      diff -= sign * (group.cost + ratio * group.capacity);
     }
   }
   buffer->reverse();
   if (copy_buffer)
-    hb_buffer_destroy(copy_buffer);
+    session->releaseBuffer(copy_buffer);
 
 }
 
-void OtLayout::jutifyLine_old(hb_font_t * shapefont, hb_buffer_t * text_buffer, int lineWidth, int emScale, bool tajweedColor) {
-
-  const int minSpace = OtLayout::MINSPACEWIDTH * emScale;
-  const int  defaultSpace = OtLayout::SPACEWIDTH * emScale;
-  double nuqta = this->nuqta() * emScale;
-
-  auto  copy_buffer_properties = [](hb_buffer_t* dst, hb_buffer_t* src)
-  {
-    hb_segment_properties_t props;
-    hb_buffer_get_segment_properties(src, &props);
-    hb_buffer_set_segment_properties(dst, &props);
-    hb_buffer_set_flags(dst, hb_buffer_get_flags(src));
-    hb_buffer_set_cluster_level(dst, hb_buffer_get_cluster_level(src));
-  };
-
-
-  auto copyBuffer = [&](hb_buffer_t* des_buffer, hb_buffer_t* source_buffer)
-  {
-    hb_buffer_clear_contents(des_buffer);
-    copy_buffer_properties(des_buffer, source_buffer);
-    hb_buffer_append(des_buffer, source_buffer, 0, -1);
-  };
-
-  hb_feature_t color_fea{ HB_TAG('t', 'j', 'w', 'd'),0,0,(uint)-1 };
-  if (tajweedColor) {
-    color_fea.value = 1;
-  }
-
-  hb_feature_t gpos_features[] = {
-    {HB_TAG('i', 'n', 'i', 't'),0,0,(uint)-1},
-    {HB_TAG('m', 'e', 'd', 'i'),0,0,(uint)-1},
-    {HB_TAG('f', 'i', 'n', 'a'),0,0,(uint)-1},
-    {HB_TAG('r', 'l', 'i', 'g'),0,0,(uint)-1},
-    {HB_TAG('l', 'i', 'g', 'a'),0,0,(uint)-1},
-    {HB_TAG('c', 'a', 'l', 't'),0,0,(uint)-1},
-    {HB_TAG('s', 'c', 'h', 'm'),1,0,(uint)-1},
-    {HB_TAG('s', 'h', 'r', '1'),0,0,(uint)-1},
-    color_fea
-  };
-
-  int num_gpos_features = sizeof(gpos_features) / sizeof(*gpos_features);
-
-  uint glyph_count;
-
-  hb_segment_properties_t savedprops;
-
-  hb_buffer_get_segment_properties(text_buffer, &savedprops);
-
-
-  hb_buffer_t* buffer = hb_buffer_create();
-  copyBuffer(buffer, text_buffer);
-
-  /*buffer->justifyLine = true;
-  buffer->lineWidth = lineWidth;*/
-
-  hb_shape(shapefont, buffer, &color_fea, 1);
-
-
-  if (applyJustification && lineWidth != 0) {
-
-    JustificationInProgress = true;
-    bool continueJustification = true;
-    bool schr1applied = false;
-    while (continueJustification) {
-
-      continueJustification = false;
-
-      hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
-      hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
-      QVector<quint32> spaces;
-      int currentlineWidth = 0;
-
-
-      for (int i = glyph_count - 1; i >= 0; i--) {
-        if (glyph_info[i].codepoint == 32) {
-          glyph_pos[i].x_advance = minSpace;
-          spaces.append(i);
-        }
-        else {
-          currentlineWidth += glyph_pos[i].x_advance;
-        }
-      }
-
-      double diff = (double)lineWidth - currentlineWidth - spaces.size() * (double)defaultSpace;
-
-      bool needgpos = false;
-      if (diff > 0) {
-        applyJustFeature(buffer, needgpos, diff, "sch1", shapefont, nuqta, emScale);
-      }
-      //shrink
-      else {
-
-        if (!schr1applied) {
-          hb_feature_t festures2[2];
-          festures2[0].tag = HB_TAG('s', 'h', 'r', '1');
-          festures2[0].value = 1;
-          festures2[0].start = 0;
-          festures2[0].end = -1;
-
-          festures2[1] = color_fea;
-
-          copyBuffer(buffer, text_buffer);
-
-          hb_shape(shapefont, buffer, festures2, 2);
-
-          continueJustification = true;
-          schr1applied = true;
-        }
-        else {
-          applyJustFeature(buffer, needgpos, diff, "shr2", shapefont, nuqta, emScale);
-        }
-      }
-
-      if (needgpos) {
-        buffer->reverse();
-        buffer->justContext = nullptr;
-        gpos_features[7].value = schr1applied ? 1 : 0;;
-
-        hb_shape(shapefont, buffer, gpos_features, num_gpos_features);
-        //hb_shape(shapefont, buffer, nullptr, 0);
-      }
-    }
-    JustificationInProgress = false;
-  }
-  copyBuffer(text_buffer, buffer);
-
-  hb_buffer_destroy(buffer);
-}
-
 void OtLayout::jutifyLine(hb_font_t * shapefont, hb_buffer_t * text_buffer, int lineWidth, int emScale, bool tajweedColor) {
 
-  if (applyJustification && lineWidth != 0) {
+  ShapingContext* context = ShapingContext::fromFont(shapefont);
+
+  if (context->applyJustification && lineWidth != 0) {
     hb_buffer_set_justify(text_buffer, lineWidth);
     //text_buffer->justifyLine = true;    
     //text_buffer->lineWidth = lineWidth;
@@ -2431,7 +2345,7 @@ void OtLayout::jutifyLine(hb_font_t * shapefont, hb_buffer_t * text_buffer, int
   features[1].start = 0;
   features[1].end = -1;
 
-  JustificationInProgress = true;
+  context->justificationInProgress = true;
   hb_shape(shapefont, text_buffer, features, 2);
   /*
   if (tajweedColor) {
@@ -2443,7 +2357,7 @@ void OtLayout::jutifyLine(hb_font_t * shapefont, hb_buffer_t * text_buffer, int
   else {
     hb_shape(shapefont, text_buffer, nullptr, 0);
   }*/
-  JustificationInProgress = false;
+  context->justificationInProgress = false;
 
 }
 
@@ -2451,8 +2365,14 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
 
   QList<LineLayoutInfo> page;
 
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
-  hb_font_t* shapefont = this->createFont(emScale, newFace);
+  ShapingSession::Buffer pooledBuffer{ *session };
+  ShapingSession::Font pooledFont{ *session, emScale, newFace };
+
+  hb_buffer_t* buffer = pooledBuffer;
+  hb_font_t* shapefont = pooledFont;
+
+  ShapingContext* context = ShapingContext::fromFont(shapefont);
+  ShapingContext::Scope contextScope{ context };
 
   const int minSpace = OtLayout::MINSPACEWIDTH * emScale;
   const int  defaultSpace = OtLayout::SPACEWIDTH * emScale;
@@ -2513,6 +2433,9 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
 
   for (auto& line : lines) {
 
+    // the shaping callbacks of the line use the alternates while other pages may evict them
+    PinnedAlternates pinned{ this };
+
     initializeBuffer(buffer, &savedprops, line);
     //hb_buffer_set_cluster_level(buffer, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
     // hb_buffer_set_message_func(buffer, setMessage, this, NULL);
@@ -2532,19 +2455,50 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
     if (whichJust == WhichJust::HarfBuzz) {
       jutifyLine(shapefont, buffer, lineWidth, emScale, tajweedColor);
     }
-    else if (whichJust == WhichJust::Second) {
-      jutifyLine_old(shapefont, buffer, lineWidth, emScale, tajweedColor);
-    }
     else {
 
-      hb_shape(shapefont, buffer, &color_fea, 1);
+      hb_feature_t shr1_features[2];
+      shr1_features[0].tag = HB_TAG('s', 'h', 'r', '1');
+      shr1_features[0].value = 1;
+      shr1_features[0].start = 0;
+      shr1_features[0].end = -1;
+
+      shr1_features[1] = color_fea;
+
+      // The width of the line before shr1 tells whether it shrinks. It is read from the cached word runs, or the
+      // line is shaped once if they are missing, so the line is then shaped a single time, with or without shr1.
+      ShapedRunCache::Glyphs natural;
+      bool shaped = shapedRuns->shape(shapefont, buffer, line, &color_fea, 1, natural);
 
+      bool schr1applied = false;
 
-      if (applyJustification && lineWidth != 0) {
+      if (context->applyJustification && lineWidth != 0) {
+        int naturalWidth = 0;
+        int naturalSpaces = 0;
+        for (size_t i = 0; i < natural.infos.size(); i++) {
+          if (natural.infos[i].codepoint == 32) {
+            naturalSpaces++;
+          }
+          else {
+            naturalWidth += natural.positions[i].x_advance;
+          }
+        }
+        schr1applied = (double)lineWidth - naturalWidth - naturalSpaces * (double)defaultSpace <= 0;
+      }
 
-        JustificationInProgress = true;
+      if (schr1applied) {
+        initializeBuffer(buffer, &savedprops, line);
+        hb_shape(shapefont, buffer, shr1_features, 2);
+      }
+      else if (!shaped) {
+        initializeBuffer(buffer, &savedprops, line);
+        hb_shape(shapefont, buffer, &color_fea, 1);
+      }
+
+      if (context->applyJustification && lineWidth != 0) {
+
+        context->justificationInProgress = true;
         bool continueJustification = true;
-        bool schr1applied = false;
         while (continueJustification) {
 
           continueJustification = false;
@@ -2574,18 +2528,11 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
           //shrink
           else {
 
+            // only when the cached runs gave a narrower line than the shaping
             if (!schr1applied) {
-              hb_feature_t festures2[2];
-              festures2[0].tag = HB_TAG('s', 'h', 'r', '1');
-              festures2[0].value = 1;
-              festures2[0].start = 0;
-              festures2[0].end = -1;
-
-              festures2[1] = color_fea;
-
               initializeBuffer(buffer, &savedprops, line);
 
-              hb_shape(shapefont, buffer, festures2, 2);
+              hb_shape(shapefont, buffer, shr1_features, 2);
 
               continueJustification = true;
               schr1applied = true;
@@ -2604,7 +2551,7 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
             //hb_shape(shapefont, buffer, nullptr, 0);
           }
         }
-        JustificationInProgress = false;
+        context->justificationInProgress = false;
       }
     }
 
@@ -2698,13 +2645,165 @@ QList<LineLayoutInfo> OtLayout::justifyPage(int emScale, int lineWidth, int page
     currentyPos = currentyPos + (InterLineSpacing << OtLayout::SCALEBY);
   }
 
-  hb_font_destroy(shapefont);
-  hb_buffer_destroy(buffer);
+  if (batchAlternates) {
+    generatePageAlternates(page);
+  }
 
   return page;
 
 }
 
+LayoutPages OtLayout::shapeMedina(int emScale, int lineWidth, int threadCount) {
+
+  constexpr int pageCount = 604;
+
+  struct ShapedPage {
+    QList<LineLayoutInfo> lines;
+    QStringList text;
+    int beginsajda = 0;
+    int endsajda = 0;
+    int sajdamatched = 0;
+  };
+
+  std::vector<ShapedPage> shapedPages(pageCount);
+
+  // the pages share the face, alternates are generated concurrently only with a MetaPost instance pool
+  hb_face_destroy(updateFace(true));
+
+  if (mpInstancePool == nullptr) {
+    threadCount = 1;
+  }
+
+  auto shapePage = [&](int pagenum) {
+
+    QString suraWord = "سُورَةُ";
+    QString bism = "بِسْمِ ٱللَّهِ ٱلرَّحْمَٰنِ ٱلرَّحِيمِ";
+
+    QString surapattern = "^("
+      + suraWord + " .*|"
+      + bism
+      + "|" + "بِّسْمِ ٱللَّهِ ٱلرَّحْمَٰنِ ٱلرَّحِيمِ"
+      + ")$";
+
+    QRegularExpression surabism(surapattern, QRegularExpression::MultilineOption);
+
+    QString sajdapatterns = "(وَٱسْجُدْ) وَٱقْتَرِب|(خَرُّوا۟ سُجَّدࣰا)|(وَلِلَّهِ يَسْجُدُ)|(يَسْجُدُونَ)۩|(فَٱسْجُدُوا۟ لِلَّهِ)|(وَٱسْجُدُوا۟ لِلَّهِ)|(أَلَّا يَسْجُدُوا۟ لِلَّهِ)|(وَخَرَّ رَاكِعࣰا)|(يَسْجُدُ لَهُ)|(يَخِرُّونَ لِلْأَذْقَانِ سُجَّدࣰا)|(ٱسْجُدُوا۟) لِلرَّحْمَٰنِ|ٱرْكَعُوا۟ (وَٱسْجُدُوا۟)";
+    QRegularExpression sajdaRe = QRegularExpression(sajdapatterns, QRegularExpression::MultilineOption);
+
+    ShapedPage& shapedPage = shapedPages[pagenum];
+
+    QString textt = QString::fromUtf8(qurantext[pagenum] + 1);
+
+    textt = textt.replace(QRegularExpression(" *" + QString("۞") + " *"), QString("۞") + " ");
+
+    auto lines = textt.split(char(10), Qt::SkipEmptyParts);
+
+    auto justification = LineJustification::Distribute;
+    int beginsura = OtLayout::TopSpace << OtLayout::SCALEBY;
+
+    if (pagenum == 0 || pagenum == 1) {
+      justification = LineJustification::Center;
+      beginsura = (OtLayout::TopSpace + (OtLayout::InterLineSpacing * 3)) << OtLayout::SCALEBY;
+    }
+
+    auto page = justifyPage(emScale, lineWidth, lineWidth, lines, justification, false, true);
+
+    for (int i = 0; i < page.size(); ++i) {
+
+      auto& currentpage = page[i];
+
+      // check if suran name or bism
+      auto match = surabism.match(lines[i]);
+      if (match.hasMatch()) {
+
+        auto temp = justifyPage(emScale, lineWidth, lineWidth, { lines[i] }, LineJustification::Center, false, true);
+
+        if (match.captured(0).startsWith("سُ")) {
+          temp[0].type = LineType::Sura;
+        }
+        else {
+          temp[0].type = LineType::Bism;
+        }
+
+        page[i] = temp[0];
+      }
+      else {
+        // check if sajda
+        match = sajdaRe.match(lines[i]);
+        if (match.hasMatch()) {
+
+          shapedPage.sajdamatched++;
+
+          int startOffset = match.capturedStart(match.lastCapturedIndex());
+          int endOffset = match.capturedEnd(match.lastCapturedIndex()) - 1;
+
+          // value does not insert in the shared map
+          while (glyphGlobalClasses.value(lines[i][endOffset].unicode()) == OtLayout::MarkGlyph)
+            endOffset--;
+
+          bool beginDone = false;
+
+          auto& glyphs = currentpage.glyphs;
+
+          for (auto& glyphLayout : glyphs) {
+
+            if (glyphLayout.cluster == startOffset && !beginDone) {
+              glyphLayout.beginsajda = true;
+              beginDone = true;
+              shapedPage.beginsajda++;
+
+            }
+            else if (glyphLayout.cluster == endOffset) {
+              glyphLayout.endsajda = true;
+              shapedPage.endsajda++;
+              break;
+            }
+
+          }
+
+        }
+      }
+
+
+      if (i == 0 && (pagenum == 0 || pagenum == 1)) {
+        page[i].type = LineType::Sura;
+        page[i].ystartposition = (OtLayout::TopSpace + (OtLayout::InterLineSpacing * 1)) << OtLayout::SCALEBY;
+      }
+      else {
+        page[i].ystartposition = beginsura;
+        beginsura += OtLayout::InterLineSpacing << OtLayout::SCALEBY;
+      }
+    }
+
+    shapedPage.lines = page;
+    shapedPage.text = lines;
+  };
+
+  PageShaper shaper{ threadCount };
+
+  shaper.run(pageCount, shapePage);
+
+  LayoutPages result;
+
+  int beginsajda = 0;
+  int endsajda = 0;
+  int sajdamatched = 0;
+
+  for (auto& shapedPage : shapedPages) {
+    result.pages.append(shapedPage.lines);
+    result.originalPages.append(shapedPage.text);
+    beginsajda += shapedPage.beginsajda;
+    endsajda += shapedPage.endsajda;
+    sajdamatched += shapedPage.sajdamatched;
+  }
+
+  if (beginsajda != 15 || endsajda != 15 || sajdamatched != 15) {
+    std::cout << "sajdas problems?" << std::endl;
+  }
+
+  return result;
+}
+
 LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVerse) {
 
 
@@ -2712,27 +2811,19 @@ LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVe
 
   typedef double ParaWidth;
 
-  struct Candidate {
-    size_t index;  // index int the text buffer
-    int prev;  // index to previous break
-    ParaWidth totalWidth;  // width of text until this point, if we decide to break here
-    double  totalDemerits;  // best demerits found for this break (index) and lineNumber
-    size_t lineNumber;  // only updated for non-constant line widths
-    size_t pageNumber;
-    size_t totalSpaces;  // preceding space count after breaking
-  };
+  typedef BreakCandidate Candidate;
 
 
   const double DEMERITS_INFTY = std::numeric_limits<double>::max();
 
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
+  ShapingSession::Buffer buffer{ *session };
 
   hb_buffer_set_direction(buffer, HB_DIRECTION_RTL);
   hb_buffer_set_script(buffer, HB_SCRIPT_ARABIC);
   hb_buffer_set_language(buffer, hb_language_from_string("ar", strlen("ar")));
   //hb_buffer_set_cluster_level(buffer, HB_BUFFER_CLUSTER_LEVEL_MONOTONE_CHARACTERS);
 
-  hb_font_t* font = this->createFont(emScale);
+  ShapingSession::Font font{ *session, emScale, true };
 
   QString quran;
 
@@ -2825,11 +2916,14 @@ LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVe
     endsajdas.insert(endOffset);
   }
 
-  hb_buffer_add_utf16(buffer, quran.utf16(), -1, 0, -1);
-
-  hb_shape(font, buffer, NULL, 0);
+  ShapedRunCache::Glyphs shaped;
+  {
+    // the alternates are only used by the shaping callbacks
+    PinnedAlternates pinned{ this };
+    shapedRuns->shape(font, buffer, quran, NULL, 0, shaped);
+  }
 
-  uint glyph_count;
+  uint glyph_count = shaped.infos.size();
 
   const int minSpaceWidth = 50 * emScale;
   const int spaceWidth = 75 * emScale;
@@ -2837,154 +2931,454 @@ LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVe
 
   //ParaWidth lineWidth = (17000 - (2 * 400)) << OtLayout::SCALEBY;
 
-  hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
-  hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+  hb_glyph_info_t* glyph_info = shaped.infos.data();
+  hb_glyph_position_t* glyph_pos = shaped.positions.data();
 
+  // The expansions of sch1 and shr2 give the tatweel each word can take in justifyPage, a word is
+  // assumed to take a single kashida so its capacity is the largest of its glyphs.
+  std::vector<ParaWidth> wordStretch(glyph_count, 0.0);
+  std::vector<ParaWidth> wordShrink(glyph_count, 0.0);
 
+  if (applyJustification) {
+    double nuqta = this->nuqta() * emScale;
+    auto stretchCapacities = getJustificationCapacities("sch1", true);
+    auto shrinkCapacities = getJustificationCapacities("shr2", false);
 
-  ParaWidth totalWidth = 0;
-  int totalSpaces = 0;
-  std::vector<int> actives;
-  std::vector<Candidate> candidates;
+    ParaWidth stretch = 0;
+    ParaWidth shrink = 0;
 
-  candidates.push_back({});
-  Candidate* initCand = &candidates.back();
+    for (int i = glyph_count - 1; i >= 0; i--) {
+      auto codepoint = glyph_info[i].codepoint;
+      if (codepoint != 10 && codepoint != 0x20) {
+        if (codepoint < stretchCapacities.size()) {
+          stretch = std::max(stretch, stretchCapacities[codepoint] * nuqta);
+        }
+        if (codepoint < shrinkCapacities.size()) {
+          shrink = std::max(shrink, shrinkCapacities[codepoint] * nuqta);
+        }
+        continue;
+      }
+      // the capacities of a word are counted at the space ending it
+      wordStretch[i] = stretch;
+      wordShrink[i] = shrink;
+      stretch = 0;
+      shrink = 0;
+    }
+  }
 
-  initCand->pageNumber = 1;
-  initCand->index = glyph_count;
-  initCand->prev = -1;
 
-  actives.push_back(0);
 
-  for (int i = glyph_count - 1; i >= 0; i--) {
+  // The sura and bism lines are forced breaks, the text between two of them is broken independently
+  // of the rest except for the line number where it begins.
+  struct Segment {
+    int start;  // index of the break before the segment
+    int end;  // index of the break ending the segment
+    ParaWidth totalWidth;  // width of text until the start
+    ParaWidth totalStretch;
+    ParaWidth totalShrink;
+    int totalSpaces;  // space count until the start
+  };
 
-    if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
-      totalWidth += glyph_pos[i].x_advance;
-      continue;
-    }
+  std::vector<Segment> segments;
 
-    totalSpaces++;
+  {
+    ParaWidth totalWidth = 0;
+    ParaWidth totalStretch = 0;
+    ParaWidth totalShrink = 0;
+    int totalSpaces = 0;
 
-    QHash<int, int> potcandidates;
+    segments.push_back({ (int)glyph_count, 0, 0, 0, 0, 0 });
 
-    auto activeit = actives.begin();
-    while (activeit != actives.end()) {
+    for (int i = glyph_count - 1; i >= 0; i--) {
+      if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
+        totalWidth += glyph_pos[i].x_advance;
+        continue;
+      }
 
-      auto active = &candidates.at(*activeit);
+      totalSpaces++;
+      totalStretch += wordStretch[i];
+      totalShrink += wordShrink[i];
 
-      // must terminate a page with end of aya
-      // A page has always 15 lines
-      if (pageFinishbyaVerse) {
-        if (active->lineNumber == 14 && !(glyph_info[i + 1].codepoint >= Automedina::AyaNumberCode && glyph_info[i + 1].codepoint <= Automedina::AyaNumberCode + 286)) {
-          activeit++;
-          continue;
+      if (lineBreaks.contains(glyph_info[i].cluster)) {
+        segments.back().end = i;
+        if (i != 0) {
+          segments.push_back({ i, 0, totalWidth, totalStretch, totalShrink, totalSpaces });
         }
       }
+    }
+  }
 
-      // calculate adjustment ratio
-      double adjRatio = 0.0;
-      int spaces = totalSpaces - active->totalSpaces;
-      ParaWidth width = (totalWidth - active->totalWidth) + spaces * spaceWidth;
-      if (width < lineWidth) {
-        adjRatio = (lineWidth - width) / (spaces * maxSpaceWidth);
+  // Without the aya constraint the breaks of a segment do not depend on its first line number, a single run counts
+  // the lines from 0 and its ends are line offsets. Otherwise a segment has a run for each first line number.
+  struct SegmentRun {
+    int segment;
+    int startLine;
+    QByteArray key;
+    std::vector<Candidate> candidates;
+    // candidate at the end of the segment per line number, -1 if none
+    int ends[16];
+  };
+
+  std::vector<SegmentRun> runs;
+  std::vector<std::vector<int>> segmentRuns(segments.size());
+
+  for (int s = 0; s < segments.size(); s++) {
+    int firstLine = s == 0 || !pageFinishbyaVerse ? 0 : 1;
+    int lastLine = s == 0 || !pageFinishbyaVerse ? 0 : 15;
+    for (int startLine = firstLine; startLine <= lastLine; startLine++) {
+      segmentRuns[s].push_back(runs.size());
+      runs.push_back({ s, startLine });
+    }
+  }
+
+  auto breakSegment = [&](int runIndex) {
+
+    SegmentRun& run = runs[runIndex];
+    const Segment& segment = segments[run.segment];
+    std::vector<Candidate>& candidates = run.candidates;
+
+    std::fill(std::begin(run.ends), std::end(run.ends), -1);
+
+    // A candidate is referenced by the candidates following it and by actives, potcandidates or ends.
+    // The slot of a candidate no longer referenced is reused.
+    std::vector<int> references;
+    std::vector<int> freeCandidates;
+
+    auto newCandidate = [&]() {
+      if (!freeCandidates.empty()) {
+        int cand = freeCandidates.back();
+        freeCandidates.pop_back();
+        return cand;
       }
-      else if (width > lineWidth) {
-        adjRatio = (lineWidth - width) / (spaces * minSpaceWidth);
+      candidates.push_back({});
+      references.push_back(0);
+      return (int)candidates.size() - 1;
+    };
+
+    auto release = [&](int cand) {
+      while (cand != -1 && --references[cand] == 0) {
+        freeCandidates.push_back(cand);
+        cand = candidates[cand].prev;
       }
+    };
+
+    ParaWidth totalWidth = segment.totalWidth;
+    ParaWidth totalStretch = segment.totalStretch;
+    ParaWidth totalShrink = segment.totalShrink;
+    int totalSpaces = segment.totalSpaces;
+    std::vector<int> actives;
+
+    int init = newCandidate();
+    Candidate* initCand = &candidates[init];
+
+    initCand->pageNumber = 1;
+    initCand->lineNumber = run.startLine;
+    initCand->index = segment.start;
+    initCand->totalWidth = totalWidth;
+    initCand->totalStretch = totalStretch;
+    initCand->totalShrink = totalShrink;
+    initCand->totalSpaces = totalSpaces;
+    initCand->prev = -1;
+
+    references[init] = 1;
+    actives.push_back(init);
 
-      if (adjRatio < -1) {
-        activeit = actives.erase(activeit);
+    // best candidate per line number at the current space
+    int potcandidates[16];
+    // lowest demerits of the actives per line number whose line is not overfull at the current space
+    double underfullDemerits[16];
+
+    for (int i = segment.start - 1; i >= segment.end; i--) {
+
+      if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
+        totalWidth += glyph_pos[i].x_advance;
         continue;
       }
 
-      double demerits = (1 + 100 * std::pow(std::abs(adjRatio), 3));
+      totalSpaces++;
+      totalStretch += wordStretch[i];
+      totalShrink += wordShrink[i];
 
-      double totalDemerits = active->totalDemerits + demerits;
+      std::fill(std::begin(potcandidates), std::end(potcandidates), -1);
+      std::fill(std::begin(underfullDemerits), std::end(underfullDemerits), DEMERITS_INFTY);
 
-      /*
-                qDebug() << "index : " << active->index
-                    << ", lineNumber : " << active->lineNumber
-                    << ", pageNumber : " << active->pageNumber
-                    << ", totalSpaces : " << active->totalSpaces
-                    << ", totalWidth : " << active->totalWidth
-                    << ",active->totalDemerits : " << active->totalDemerits
-                    << ",demerits : " << demerits
-                    << ",totalDemerits : " << totalDemerits
-                    << ",currentIndex : " << i;*/
+      // the actives are in the order of their position, the ones kept are moved to the front
+      int kept = 0;
 
-      int lineNumber = active->lineNumber + 1;
-      int pageNumber = active->pageNumber;
+      for (int activeIndex = 0; activeIndex < actives.size(); activeIndex++) {
 
-      if (lineNumber == 16) {
-        lineNumber = 1;
-        pageNumber = pageNumber + 1;
-      }
+        int activenum = actives[activeIndex];
+        const Candidate& active = candidates[activenum];
+
+        // must terminate a page with end of aya
+        // A page has always 15 lines
+        if (pageFinishbyaVerse) {
+          if (active.lineNumber == 14 && !(glyph_info[i + 1].codepoint >= Automedina::AyaNumberCode && glyph_info[i + 1].codepoint <= Automedina::AyaNumberCode + 286)) {
+            actives[kept++] = activenum;
+            continue;
+          }
+        }
 
-      //int key = (pageNumber - 1)* 15 + lineNumber;
-      int key = lineNumber;
+        int spaces = totalSpaces - active.totalSpaces;
+        ParaWidth width = (totalWidth - active.totalWidth) + spaces * spaceWidth;
 
-      if (potcandidates.contains(key)) {
-        auto& candidate = candidates.at(potcandidates[key]);
-        if (candidate.pageNumber != pageNumber && candidate.totalDemerits > totalDemerits) {
-          throw "Should not";
+        // An earlier active with the same line number and not more demerits has a longer line which is not overfull,
+        // so the line of this active stretches more and cannot give a better candidate here.
+        if (width <= lineWidth && active.totalDemerits >= underfullDemerits[active.lineNumber]) {
+          actives[kept++] = activenum;
+          continue;
+        }
+
+        // calculate adjustment ratio
+        double adjRatio = 0.0;
+        if (width < lineWidth) {
+          adjRatio = (lineWidth - width) / (spaces * maxSpaceWidth + totalStretch - active.totalStretch);
+        }
+        else if (width > lineWidth) {
+          adjRatio = (lineWidth - width) / (spaces * minSpaceWidth + totalShrink - active.totalShrink);
+        }
+
+        if (adjRatio < -1) {
+          release(activenum);
+          continue;
         }
-      }
 
+        actives[kept++] = activenum;
+
+        if (width <= lineWidth) {
+          underfullDemerits[active.lineNumber] = std::min(underfullDemerits[active.lineNumber], active.totalDemerits);
+        }
 
-      if (!potcandidates.contains(key) || candidates.at(potcandidates[key]).totalDemerits > totalDemerits) {
+        double ratio = std::abs(adjRatio);
+        double demerits = 1 + 100 * ratio * ratio * ratio;
 
+        double totalDemerits = active.totalDemerits + demerits;
+
+        int lineNumber = active.lineNumber + 1;
+        int pageNumber = active.pageNumber;
+
+        if (lineNumber == 16) {
+          lineNumber = 1;
+          pageNumber = pageNumber + 1;
+        }
 
-        potcandidates[key] = candidates.size();
+        int key = lineNumber;
 
-        candidates.push_back({});
-        Candidate* cand = &candidates.back();
+        if (potcandidates[key] == -1 || candidates[potcandidates[key]].totalDemerits > totalDemerits) {
 
+          if (potcandidates[key] != -1) {
+            release(potcandidates[key]);
+          }
 
-        cand->lineNumber = lineNumber;
-        cand->pageNumber = pageNumber;
+          int candnum = newCandidate();
+          potcandidates[key] = candnum;
+          references[candnum] = 1;
+          references[activenum]++;
 
-        cand->index = i;
-        cand->totalSpaces = totalSpaces;
-        cand->totalWidth = totalWidth;
-        cand->totalDemerits = totalDemerits;
-        cand->prev = *activeit;
+          Candidate* cand = &candidates[candnum];
 
+          cand->lineNumber = lineNumber;
+          cand->pageNumber = pageNumber;
 
+          cand->index = i;
+          cand->totalSpaces = totalSpaces;
+          cand->totalWidth = totalWidth;
+          cand->totalStretch = totalStretch;
+          cand->totalShrink = totalShrink;
+          cand->totalDemerits = totalDemerits;
+          cand->prev = activenum;
+        }
       }
 
-      activeit++;
+      actives.resize(kept);
+
+      for (int key = 1; key < 16; key++) {
+        int cand = potcandidates[key];
+        if (cand == -1) continue;
+        if (i == segment.end) {
+          run.ends[key] = cand;
+        }
+        else {
+          actives.push_back(cand);
+        }
+      }
     }
 
-    if (lineBreaks.contains(glyph_info[i].cluster)) {
-      actives.clear();
+    // keeps only the candidates leading to the ends
+    std::vector<Candidate> reachable;
+    std::vector<int> remap(candidates.size(), -1);
+    std::vector<int> chain;
+
+    for (int& end : run.ends) {
+      if (end == -1) continue;
+      chain.clear();
+      for (int cand = end; cand != -1 && remap[cand] == -1; cand = candidates[cand].prev) {
+        chain.push_back(cand);
+      }
+      for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        Candidate cand = candidates[*it];
+        cand.prev = cand.prev != -1 ? remap[cand.prev] : -1;
+        remap[*it] = reachable.size();
+        reachable.push_back(cand);
+      }
+      end = remap[end];
     }
 
-    for (auto cand : potcandidates) {
-      actives.push_back(cand);
+    candidates = std::move(reachable);
+  };
+
+  // The breaks of a run only depend on the content of its segment. The runs of the segments unchanged since the last
+  // pageBreak are taken from brokenSegments with their positions moved, after an edit only the edited segments are broken.
+  std::vector<int> toBreak;
+
+  for (int s = 0; s < segments.size(); s++) {
+    const Segment& segment = segments[s];
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    auto addData = [&hash](auto value) {
+      hash.addData(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    addData(emScale);
+    addData(lineWidth);
+    addData(pageFinishbyaVerse);
+
+    // the glyph before the segment is read by the aya constraint
+    for (int i = std::min(segment.start, (int)glyph_count - 1); i >= segment.end; i--) {
+      addData(glyph_info[i].codepoint);
+      addData(glyph_pos[i].x_advance);
+      addData(wordStretch[i]);
+      addData(wordShrink[i]);
     }
 
+    QByteArray segmentKey = hash.result();
+
+    for (int runIndex : segmentRuns[s]) {
+      SegmentRun& run = runs[runIndex];
+      run.key = segmentKey + char(run.startLine);
+
+      auto find = brokenSegments.find(run.key);
+      if (find == brokenSegments.end()) {
+        toBreak.push_back(runIndex);
+        continue;
+      }
+
+      const BrokenSegment& broken = find.value();
+
+      run.candidates = broken.candidates;
+      std::copy(std::begin(broken.ends), std::end(broken.ends), std::begin(run.ends));
+
+      for (auto& cand : run.candidates) {
+        cand.index += segment.start - broken.start;
+        cand.totalWidth += segment.totalWidth - broken.totalWidth;
+        cand.totalStretch += segment.totalStretch - broken.totalStretch;
+        cand.totalShrink += segment.totalShrink - broken.totalShrink;
+        cand.totalSpaces += segment.totalSpaces - broken.totalSpaces;
+      }
+    }
   }
 
-  Candidate* bestCandidate = nullptr;
+  PageShaper segmentBreaker;
+
+  segmentBreaker.run(toBreak.size(), [&](int index) {
+    breakSegment(toBreak[index]);
+  });
+
+  // keeps the runs for the next pageBreak once their candidates are no longer needed
+  auto keepSegments = [&]() {
+    brokenSegments.clear();
+    for (auto& run : runs) {
+      const Segment& segment = segments[run.segment];
+      BrokenSegment& broken = brokenSegments[run.key];
+      broken.start = segment.start;
+      broken.totalWidth = segment.totalWidth;
+      broken.totalStretch = segment.totalStretch;
+      broken.totalShrink = segment.totalShrink;
+      broken.totalSpaces = segment.totalSpaces;
+      broken.candidates = std::move(run.candidates);
+      std::copy(std::begin(run.ends), std::end(run.ends), std::begin(broken.ends));
+    }
+  };
+
+  // best demerits per line number at the end of each segment and the run reaching it
+  struct Stitch {
+    double totalDemerits = DEMERITS_INFTY;
+    int run = -1;
+    int candidate = -1;
+    int startLine = -1;
+  };
+
+  std::vector<std::vector<Stitch>> stitches(segments.size(), std::vector<Stitch>(16));
+
+  std::vector<double> best(16, DEMERITS_INFTY);
+  best[0] = 0;
+
+  for (int s = 0; s < segments.size(); s++) {
 
-  double best = DEMERITS_INFTY;
-  for (auto activenum : actives) {
-    auto active = &candidates.at(activenum);
-    //qDebug() << "index : " << active->index << ", lineNumber : " << active->lineNumber << "Total demerits : " << active->totalDemerits;
-    if (active->index == 0 && active->totalDemerits < best && active->lineNumber == 15) {
-      best = active->totalDemerits;
-      bestCandidate = active;
+    auto& current = stitches[s];
+
+    for (int runIndex : segmentRuns[s]) {
+      auto& run = runs[runIndex];
+      for (int startLine = 0; startLine < 16; startLine++) {
+        if (best[startLine] == DEMERITS_INFTY || (pageFinishbyaVerse && startLine != run.startLine)) continue;
+        for (int endLine = 1; endLine < 16; endLine++) {
+          if (run.ends[endLine] == -1) continue;
+          int lineNumber = pageFinishbyaVerse ? endLine : (startLine + endLine - 1) % 15 + 1;
+          double totalDemerits = best[startLine] + run.candidates.at(run.ends[endLine]).totalDemerits;
+          if (totalDemerits < current[lineNumber].totalDemerits) {
+            current[lineNumber] = { totalDemerits, runIndex, run.ends[endLine], startLine };
+          }
+        }
+      }
     }
 
+    for (int lineNumber = 0; lineNumber < 16; lineNumber++) {
+      best[lineNumber] = current[lineNumber].totalDemerits;
+    }
   }
 
-  if (bestCandidate == nullptr) {
+  if (best[15] == DEMERITS_INFTY) {
+    keepSegments();
     //QMessageBox msgBox;
     //msgBox.setText("No feasable solution. Try to change the scale.");
     //msgBox.exec();
     return {};
   }
 
+  // chains the breaks of the best runs and numbers their lines from the beginning
+  std::vector<Candidate> breaks;
+
+  int lineNumber = 15;
+  for (int s = segments.size() - 1; s >= 0; s--) {
+    auto& stitch = stitches[s][lineNumber];
+    auto& candidates = runs[stitch.run].candidates;
+    for (int cand = stitch.candidate; candidates.at(cand).prev != -1; cand = candidates.at(cand).prev) {
+      breaks.push_back(candidates.at(cand));
+    }
+    lineNumber = stitch.startLine;
+  }
+
+  std::vector<Candidate> candidates;
+
+  candidates.push_back({});
+  candidates.back().pageNumber = 1;
+  candidates.back().index = glyph_count;
+  candidates.back().prev = -1;
+
+  for (auto it = breaks.rbegin(); it != breaks.rend(); ++it) {
+    Candidate cand = *it;
+    int lineCount = candidates.size();
+    cand.prev = candidates.size() - 1;
+    cand.lineNumber = (lineCount - 1) % 15 + 1;
+    cand.pageNumber = (lineCount - 1) / 15 + 1;
+    candidates.push_back(cand);
+  }
+
+  keepSegments();
+
+  Candidate* bestCandidate = &candidates.back();
+
   QList<LineLayoutInfo> currentPage;
   QList<QList<LineLayoutInfo>> pages;
   QStringList originalPage;
@@ -3222,8 +3616,6 @@ LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVe
     }
   }
 
-  delete font;
-  hb_buffer_destroy(buffer);
 
   //Compare text
 
@@ -3258,14 +3650,106 @@ LayoutPages OtLayout::pageBreak(int emScale, int lineWidth, bool pageFinishbyaVe
 
 }
 int OtLayout::AlternatelastCode = 0xF0000;
+void OtLayout::generatePageAlternates(const QList<LineLayoutInfo>& page) {
+
+  std::unique_lock<std::mutex> lock(alternateMutex);
+
+  // the page is drawn with getGlyph outside the justification
+  auto pool = extended ? AlternateLruCache::Pool::Default : AlternateLruCache::Pool::Detached;
+
+  std::unordered_map<int, std::unordered_set<GlyphParameters>> requested;
+  QVector<QPair<int, GlyphParameters>> requests;
+  QVector<QPair<QString, GlyphParameters>> macroRequests;
+
+  for (auto& line : page) {
+    for (auto& glyph : line.glyphs) {
+      if (glyph.lefttatweel == 0 && glyph.righttatweel == 0) continue;
+
+      GlyphParameters parameters{};
+      parameters.lefttatweel = glyph.lefttatweel;
+      parameters.righttatweel = glyph.righttatweel;
+
+      auto name = glyphNamePerCode.value(glyph.codepoint);
+      // getAlternate maps the added glyphs to their original one
+      if (name.isEmpty() || name.contains(".added_")) continue;
+
+      if (alternates->find(pool, glyph.codepoint, parameters, false) != nullptr) continue;
+      if (!requested[glyph.codepoint].insert(parameters).second) continue;
+
+      GlyphVis cached;
+      if (alternateCache->load(name, parameters, cached)) {
+        GlyphVis* newglyph = new GlyphVis{ std::move(cached) };
+        newglyph->expanded = true;
+        alternates->insert(pool, glyph.codepoint, parameters, newglyph, true);
+        continue;
+      }
+
+      requests.append({ glyph.codepoint, parameters });
+      macroRequests.append({ name, parameters });
+    }
+  }
+
+  if (requests.empty()) return;
+
+  MP instance = automedina->mp;
+  std::shared_ptr<MpInstancePool> instancePool = mpInstancePool;
+  MpInstancePool::Lease lease;
+
+  if (instancePool != nullptr) {
+    lock.unlock();
+    lease = instancePool->acquire();
+    instance = lease.instance();
+  }
+
+  auto edges = automedina->instantiateAlternates(instance, macroRequests, AlternatelastCode + 1);
+
+  if (lease.instance() != nullptr) {
+    lock.lock();
+  }
+
+  for (int i = 0; i < edges.size(); i++) {
+    auto edge = edges[i];
+    if (edge == nullptr) continue;
+
+    auto& request = requests[i];
+
+    if (alternates->find(pool, request.first, request.second, false) == nullptr) {
+      alternateCache->store(macroRequests[i].first, request.second, edge);
+
+      GlyphVis* newglyph = new GlyphVis{ this, edge, true };
+      newglyph->expanded = true;
+
+      alternates->insert(pool, request.first, request.second, newglyph, true);
+    }
+
+    // the batch charcodes are not reused as the single alternate one
+    mp_free_edge(instance, edge);
+  }
+}
+
 GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool generateNewGlyph) {
 
+  std::unique_lock<std::mutex> lock(alternateMutex);
 
+  ShapingContext* context = ShapingContext::current();
+  bool justificationInProgress = context != nullptr && context->justificationInProgress;
 
-  auto paths = JustificationInProgress ? &alternatePaths[glyphCode] : &nojustalternatePaths[glyphCode];
+  auto pool = justificationInProgress ? AlternateLruCache::Pool::Justification : AlternateLruCache::Pool::Default;
 
-  if (paths->find(parameters) != paths->end()) {
-    return paths->at(parameters);
+  // non extended alternates not added to the glyph set are kept apart so that generateNewGlyph still adds them
+  auto findAlternate = [this, pool, generateNewGlyph](int code, const GlyphParameters& parameters) {
+    bool detached = !extended && !generateNewGlyph;
+    GlyphVis* found = alternates->find(pool, code, parameters, !detached);
+    if (found == nullptr && detached) {
+      found = alternates->find(AlternateLruCache::Pool::Detached, code, parameters);
+    }
+    return found;
+  };
+
+  GlyphVis* found = findAlternate(glyphCode, parameters);
+
+  if (found != nullptr) {
+    return found;
   }
   else {
 
@@ -3276,43 +3760,74 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
       parameters.lefttatweel += glyph->charlt;
       parameters.righttatweel += glyph->charrt;
 
-      quint16 oldlyphCode = glyphCodePerName[originalGlyph];
+      quint16 oldlyphCode = glyphCodePerName.value(originalGlyph);
 
-      paths = JustificationInProgress ? &alternatePaths[oldlyphCode] : &nojustalternatePaths[oldlyphCode];
+      glyphCode = oldlyphCode;
 
-      if (paths->find(parameters) != paths->end()) {
-        return paths->at(parameters);
+      found = findAlternate(glyphCode, parameters);
+
+      if (found != nullptr) {
+        return found;
       }
 
-      glyph = &glyphs[originalGlyph];
+      glyph = findGlyph(originalGlyph);
 
     }
 
-    automedina->addchar(glyph->name, AlternatelastCode, parameters.lefttatweel, parameters.righttatweel, parameters.leftextratio, parameters.rightextratio,
-      parameters.left_tatweeltension, parameters.right_tatweeltension, "alternatechar", parameters.which_in_baseline);
+    GlyphVis cached;
+    mp_edge_object* edge = nullptr;
+    std::shared_ptr<MpInstancePool> instancePool = mpInstancePool;
+    MpInstancePool::Lease lease;
 
-    mp_run_data* _mp_results = mp_rundata(automedina->mp);
+    bool fromCache = alternateCache->load(glyph->name, parameters, cached);
 
+    if (!fromCache && interpolator->tolerance() > 0) {
+      QString glyphName = glyph->name;
+      // the first interpolation of a glyph generates its masters
+      lock.unlock();
+      fromCache = interpolator->interpolate(glyphName, parameters, cached);
+      lock.lock();
+      found = findAlternate(glyphCode, parameters);
+      if (found != nullptr) {
+        return found;
+      }
+      glyph = findGlyph(glyphName);
+    }
 
-    mp_edge_object* p = _mp_results->edges;
+    if (!fromCache) {
 
-    mp_edge_object* edge = nullptr;
-    while (p) {
-      if (p->charcode == AlternatelastCode) {
-        edge = p;
-        break;
+      MP instance = automedina->mp;
+      QString glyphName = glyph->name;
+
+      if (instancePool != nullptr) {
+        // MetaPost runs unlocked on a leased instance; the edge stays valid until the lease is released
+        lock.unlock();
+        lease = instancePool->acquire();
+        instance = lease.instance();
+      }
+
+      edge = automedina->instantiateAlternate(instance, glyphName, AlternatelastCode, parameters);
+
+      if (edge == nullptr) {
+        throw "Error";
       }
-      p = p->next;
-    }
 
-    if (edge == nullptr) {
-      throw "Error";
+      if (lease.instance() != nullptr) {
+        lock.lock();
+        found = findAlternate(glyphCode, parameters);
+        if (found != nullptr) {
+          return found;
+        }
+        glyph = findGlyph(glyphName);
+      }
+
+      alternateCache->store(glyph->name, parameters, edge);
     }
 
     GlyphVis* newglyph = nullptr;
 
     if (extended || !generateNewGlyph) {
-      newglyph = new	GlyphVis{ this, edge, true };
+      newglyph = fromCache ? new GlyphVis{ std::move(cached) } : new	GlyphVis{ this, edge, true };
       newglyph->expanded = true;
     }
     else {
@@ -3320,7 +3835,7 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
       quint16 charcode = glyphNamePerCode.keys().last() + 1;
       QString name = QString("%1.added_%2").arg(glyph->name).arg(charcode);
 
-      GlyphVis& temp = *glyphs.insert(name, GlyphVis(this, edge, true));
+      GlyphVis& temp = *glyphs.insert(name, fromCache ? cached : GlyphVis(this, edge, true));
 
       newglyph = &temp;
 
@@ -3342,6 +3857,11 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
         }
       }
 
+      updateGlyphTableEntry(newglyph->charcode);
+      // the GDEF class of the new glyph is in the table of the next face
+      dirty = true;
+      glyphTablesVersion++;
+
       QMap<QString, GlyphVisAnchor>::iterator i;
       for (i = newglyph->anchors.begin(); i != newglyph->anchors.end(); ++i) {
         auto anchor = i.value();
@@ -3368,15 +3888,14 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
     }
 
     if (!extended && !generateNewGlyph) {
-      //TODO: Memeory leak, used during OpenType generation
-      return newglyph;
+      alternates->insert(AlternateLruCache::Pool::Detached, glyphCode, parameters, newglyph, true);
     }
     else {
-      paths->insert({ parameters, newglyph });
-
-      return paths->at(parameters);
+      alternates->insert(pool, glyphCode, parameters, newglyph, extended || !generateNewGlyph);
     }
 
+    return newglyph;
+
 
   }
 
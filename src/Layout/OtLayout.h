@@ -24,6 +24,7 @@
 #include <QByteArray>
 #include <QMap>
 #include <QSet>
+#include <QHash>
 #include <QVector>
 #include <qpoint.h>
 #include <optional>
@@ -37,6 +38,9 @@
 #include "commontypes.h"
 #include <stdexcept>
 #include <iostream>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
 
 
@@ -47,6 +51,14 @@ struct hb_font_t;
 struct hb_face_t;
 class Automedina;
 class GlyphVis;
+class AlternateCache;
+class AlternateLruCache;
+class GlyphInterpolator;
+class GlyphMetricsCache;
+class ShapingSession;
+class TableBlobStore;
+class ShapedRunCache;
+class MpInstancePool;
 struct Subtable;
 class MarkBaseSubtable;
 
@@ -133,6 +145,30 @@ struct LayoutPages {
   QList<QString> suraNamebyPage;
 };
 
+struct BreakCandidate {
+  size_t index;  // index int the text buffer
+  int prev;  // index to previous break
+  double totalWidth;  // width of text until this point, if we decide to break here
+  double totalStretch;  // tatweel the justification can add to the words until this point
+  double totalShrink;  // tatweel the justification can remove from the words until this point
+  double  totalDemerits;  // best demerits found for this break (index) and lineNumber
+  size_t lineNumber;  // only updated for non-constant line widths
+  size_t pageNumber;
+  size_t totalSpaces;  // preceding space count after breaking
+};
+
+// breaks found by pageBreak between two forced breaks for a first line number
+struct BrokenSegment {
+  int start;
+  double totalWidth;
+  double totalStretch;
+  double totalShrink;
+  int totalSpaces;
+  std::vector<BreakCandidate> candidates;
+  // candidate at the end of the segment per line number, -1 if none
+  int ends[16];
+};
+
 struct SuraLocation {
   QString name;
   int pageNumber;
@@ -154,6 +190,9 @@ class AnchorCalc {
 public:
   virtual QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) { return QPoint(0, 0); };
   QPoint getAdjustment(Automedina& y, MarkBaseSubtable& subtable, GlyphVis* curr, QString className, QPoint adjust, double lefttatweel, double righttatweel, GlyphVis** poriginalglyph);
+  // the anchors are calculated on the shaping threads, nullptr when the glyph does not exist
+  GlyphVis* getGlyph(Automedina& y, const QString& name);
+  QPoint getBaseParameter(MarkBaseSubtable& subtable, const QString& className, const QString& glyphName);
 
 };
 
@@ -193,6 +232,8 @@ public:
   constexpr static int InterLineSpacing = 1800; // 1785;
   constexpr static int TopSpace = 1450; //1600
   constexpr static int Margin = 400;
+  // memory budget in bytes of the generated alternates until setAlternatesBudget is called
+  constexpr static size_t DefaultAlternatesBudget = 256 * 1024 * 1024;
 
 
   enum GDEFClasses {
@@ -213,6 +254,20 @@ public:
 
   void readJson(const QJsonObject& json);
   hb_font_t* createFont(int scale, bool newFace = true);
+  // referenced current face, newFace recreates it if the lookups changed (dirty) since it was created
+  hb_face_t* updateFace(bool newFace);
+  // fonts and buffers reused by justifyPage and pageBreak
+  ShapingSession* session;
+  // word runs of the unjustified text shaped by pageBreak
+  ShapedRunCache* shapedRuns;
+  // segments broken by the last pageBreak keyed by their content, only the edited segments are broken again
+  QHash<QByteArray, BrokenSegment> brokenSegments;
+  // tables of the faces, serialized again when the version of their content changes
+  TableBlobStore* tableBlobs;
+  // GDEF, GSUB, GPOS and JTST, incremented when updateFace creates a face
+  std::atomic<quint64> layoutTablesVersion{ 0 };
+  // cmap, name, fvar, HVAR, hmtx, hhea and post, incremented when the glyph set or the glyphs change
+  std::atomic<quint64> glyphTablesVersion{ 0 };
   QSet<quint16> classtoUnicode(QString className);
   QSet<quint16> regexptoUnicode(QString regexp);
 
@@ -287,6 +342,32 @@ public:
   double getNumericVariable(QString name);
 
   GlyphVis* getGlyph(int code);
+
+  // per glyph code data read by the shaping callbacks instead of the name keyed maps
+  struct GlyphTableEntry {
+    // glyph name properties tested by the shaping callbacks
+    enum Flags : quint8 {
+      Expanded = 0x01
+    };
+
+    GlyphVis* glyph = nullptr;
+    const ValueLimits* limits = nullptr;
+    quint8 gdefClass = 0;
+    bool isMark = false;
+    quint8 flags = 0;
+  };
+
+  // rebuilt when the glyph set or the glyph codes change
+  void updateGlyphTable();
+
+  const GlyphTableEntry* glyphEntry(unsigned int code) const {
+    return code < glyphTable.size() && glyphTable[code].glyph != nullptr ? &glyphTable[code] : nullptr;
+  }
+  // unlike glyphs[name], does not insert or detach so it can be called on the shaping threads
+  GlyphVis* findGlyph(const QString& name) const {
+    auto glyph = glyphs.constFind(name);
+    return glyph != glyphs.constEnd() ? const_cast<GlyphVis*>(&glyph.value()) : nullptr;
+  }
   GlyphVis* getGlyph(QString name, double lefttatweel, double righttatweel);
   GlyphVis* getGlyph(int code, double lefttatweel, double righttatweel);
 
@@ -294,12 +375,37 @@ public:
 
   QList<LineLayoutInfo> justifyPage(int emScale, int lineWidth, int pageWidth, QStringList lines, LineJustification justification, bool newFace, bool tajweedColor);
   LayoutPages pageBreak(int emScale, int lineWidth, bool pageFinishbyaVerse);
+  // shapes the 604 pages of the Medina mushaf, the pages are shaped in parallel when a MetaPost instance pool exists
+  LayoutPages shapeMedina(int emScale, int lineWidth, int threadCount);
 
+  // default of the ShapingContext of the fonts created by createFont
   bool applyJustification = true;
 
   GlyphVis* getAlternate(int glyphCode, GlyphParameters parameters, bool generateNewGlyph = false);
 
   void clearAlternates();
+  // memory budget in bytes of the generated alternates, 0 = unlimited, DefaultAlternatesBudget by default
+  void setAlternatesBudget(size_t bytes);
+  // maximum error in font units of interpolated alternates, 0 (default) always uses MetaPost
+  void setInterpolationTolerance(double tolerance);
+  // tatweel step of the metrics cache keys, 0 = exact values
+  void setMetricsQuantization(double step);
+  // advances and anchors of the alternates used while shaping
+  GlyphMetricsCache* metricsCache;
+  // justifyPage generates in one MetaPost run the alternates of its result that getGlyph will ask to draw the page
+  bool batchAlternates = false;
+  void generatePageAlternates(const QList<LineLayoutInfo>& page);
+
+  AlternateCache* alternateCache = nullptr;
+  // the alternates are only stored on disk once a cache file is opened, never under emscripten
+  bool openAlternateCache(const QString& fileName);
+  // the glyphs of the MetaPost instance were edited, the alternates generated from the previous sources are dropped
+  void glyphsChanged();
+
+  // getAlternate can be called concurrently once a pool of MetaPost instances is created
+  void createMpInstancePool(int size, std::string fontSource);
+  // shared with the leases in progress so that glyphsChanged can drop it
+  std::shared_ptr<MpInstancePool> mpInstancePool;
 
   void parseCppJsonLookup(QString lookupName, const QJsonObject& json);
 
@@ -315,15 +421,12 @@ public:
     fsmDriver.executeFSM(subtable, c);
   }
 
-  JustificationContext justificationContext;
-
   bool isOTVar = true;
 
   bool useNormAxisValues = true;
 
   enum class WhichJust {
     First,
-    Second,
     HarfBuzz
   };
 
@@ -373,17 +476,15 @@ public:
 
     ValueLimits limits;
 
-    const auto& name = glyphNamePerCode.value(code);
-
-    const auto& find = expandableGlyphs.find(name);
+    const GlyphTableEntry* entry = glyphEntry(code);
 
-    if (find == expandableGlyphs.end()) {
+    if (entry == nullptr || entry->limits == nullptr) {
       //throw new std::runtime_error("tatweel error for glyph " + name.toStdString());
-      std::cout << "No expandable glyph " + name.toStdString() + "\n";
+      std::cout << "No expandable glyph " + glyphNamePerCode.value(code).toStdString() + "\n";
       return tatweel;
     }
 
-    limits = find->second;
+    limits = *entry->limits;
 
     double min = left ? limits.minLeft : limits.minRight;
     double max = left ? limits.maxLeft : limits.maxRight;
@@ -426,21 +527,41 @@ private:
   QByteArray getScriptList(int featureCount);
 
 
-  double _nuqta = -1;
+  // read on first use so that a restored instance does not run its deferred input when the layout is created
+  std::atomic<double> _nuqta{ -1 };
 
   QSet<Lookup*> disabledLookups;
 
   static int AlternatelastCode;
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> alternatePaths;
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> nojustalternatePaths;
+  AlternateLruCache* alternates;
+
+  // the alternates returned by getAlternate are not deleted while the scope is alive, even if they are evicted.
+  // The evicted alternates are kept until the scope ends, so it should only cover the line or page using them.
+  class PinnedAlternates {
+  public:
+    PinnedAlternates(OtLayout* layout);
+    ~PinnedAlternates();
+    PinnedAlternates(const PinnedAlternates&) = delete;
+    PinnedAlternates& operator=(const PinnedAlternates&) = delete;
+  private:
+    OtLayout* layout;
+    quint64 ticket;
+  };
+
+  GlyphInterpolator* interpolator;
+
+  std::vector<GlyphTableEntry> glyphTable;
+  void updateGlyphTableEntry(quint16 code);
 
-  bool JustificationInProgress = false;
+  std::mutex alternateMutex;
+  // createFont replaces the face while other fonts may still use the previous one
+  std::mutex faceMutex;
 
+  // largest tatweel per glyph code that the expansions of a justification feature can add or remove, in tatweel units
+  std::vector<double> getJustificationCapacities(const QString& feature, bool stretch);
   void applyJustFeature(hb_buffer_t* buffer, bool& needgpos, double& diff, QString feature, hb_font_t* shapefont, double nuqta, int emScale);
-  void applyJustFeature_old(hb_buffer_t* buffer, bool& needgpos, double& diff, QString feature, hb_font_t* shapefont, double nuqta, int emScale);
 
   void jutifyLine(hb_font_t* shapefont, hb_buffer_t* buffer, int lineWidth, int emScale, bool tajweedColor);
-  void jutifyLine_old(hb_font_t* shapefont, hb_buffer_t* buffer, int lineWidth, int emScale, bool tajweedColor);
 
   bool extended = true;
 
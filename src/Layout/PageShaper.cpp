@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "PageShaper.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+PageShaper::PageShaper(int threadCount) : m_threadCount{ threadCount > 0 ? threadCount : 1 } {
+}
+
+void PageShaper::run(int pageCount, const Task& task) {
+
+  int threadCount = std::min(m_threadCount, pageCount);
+
+  if (threadCount <= 1) {
+    for (int pageIndex = 0; pageIndex < pageCount; pageIndex++) {
+      task(pageIndex);
+    }
+    return;
+  }
+
+  struct Range {
+    std::mutex mutex;
+    std::deque<int> pages;
+  };
+
+  std::vector<Range> ranges(threadCount);
+
+  // neighbouring pages are shaped by the same thread and share most of their alternates
+  for (int pageIndex = 0; pageIndex < pageCount; pageIndex++) {
+    ranges[(size_t)pageIndex * threadCount / pageCount].pages.push_back(pageIndex);
+  }
+
+  std::atomic<bool> stop{ false };
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto nextPage = [&](int threadIndex, int& pageIndex) {
+    {
+      Range& own = ranges[threadIndex];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.pages.empty()) {
+        pageIndex = own.pages.front();
+        own.pages.pop_front();
+        return true;
+      }
+    }
+    for (int i = 1; i < threadCount; i++) {
+      Range& victim = ranges[(threadIndex + i) % threadCount];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.pages.empty()) {
+        pageIndex = victim.pages.back();
+        victim.pages.pop_back();
+        return true;
+      }
+    }
+    return false;
+  };
+
+  auto worker = [&](int threadIndex) {
+    int pageIndex;
+    while (!stop && nextPage(threadIndex, pageIndex)) {
+      try {
+        task(pageIndex);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        stop = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+
+  for (int threadIndex = 1; threadIndex < threadCount; threadIndex++) {
+    threads.emplace_back(worker, threadIndex);
+  }
+
+  worker(0);
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <functional>
+#include <thread>
+
+/*
+  Runs a task for every page index on a set of threads. Each thread starts with a contiguous range of pages
+  and steals from the end of the other ranges when its own is done, so long pages do not leave threads idle.
+  The task writes the result of a page in its own slot, the output keeps the page order whatever the thread count.
+*/
+class PageShaper {
+public:
+  typedef std::function<void(int pageIndex)> Task;
+
+  explicit PageShaper(int threadCount = std::thread::hardware_concurrency());
+
+  // the first exception thrown by a task stops the other threads and is rethrown
+  void run(int pageCount, const Task& task);
+
+  int threadCount() const { return m_threadCount; }
+
+private:
+  int m_threadCount;
+};
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#include "ShapedRunCache.h"
+#include "OtLayout.h"
+#include <algorithm>
+
+static bool isSeparator(QChar c) {
+  return c == QChar(' ') || c == QChar('\n');
+}
+
+ShapedRunCache::ShapedRunCache(OtLayout* layout) : m_layout{ layout } {
+}
+
+void ShapedRunCache::setMaxEntries(int maxEntries) {
+  std::lock_guard<std::mutex> lock(mutex);
+  m_maxEntries = maxEntries;
+}
+
+void ShapedRunCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  runs.clear();
+}
+
+ShapedRunCache::Stats ShapedRunCache::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  m_stats.entries = runs.size();
+  return m_stats;
+}
+
+void ShapedRunCache::splitUnits(const QString& text, int start, int end, std::vector<Unit>& units) const {
+
+  int pos = start;
+
+  while (pos < end) {
+
+    int unitEnd = pos;
+    while (unitEnd < end && !isSeparator(text[unitEnd])) unitEnd++;
+
+    // the separators following a word belong to its unit
+    while (unitEnd < end && isSeparator(text[unitEnd])) unitEnd++;
+
+    units.push_back({ pos, unitEnd - pos });
+
+    pos = unitEnd;
+  }
+}
+
+QString ShapedRunCache::runKey(const QString& text, const std::vector<Unit>& units, int index, const QString& suffix) const {
+
+  QString key;
+
+  for (int i = index - 1; i <= index + 1; i++) {
+    if (i >= 0 && i < (int)units.size()) {
+      key.append(text.midRef(units[i].start, units[i].length));
+    }
+    key.append(QChar(0x1F));
+  }
+
+  key.append(suffix);
+
+  return key;
+}
+
+bool ShapedRunCache::shape(hb_font_t* font, hb_buffer_t* buffer, const QString& text, const hb_feature_t* features, unsigned int featureCount, Glyphs& result) {
+
+  result.infos.clear();
+  result.positions.clear();
+
+  hb_segment_properties_t props;
+  hb_buffer_get_segment_properties(buffer, &props);
+
+  bool backward = HB_DIRECTION_IS_BACKWARD(props.direction);
+
+  int xscale, yscale;
+  hb_font_get_scale(font, &xscale, &yscale);
+
+  QString suffix = QString("%1:%2:%3:%4").arg(xscale).arg(m_layout->layoutTablesVersion.load()).arg(m_layout->glyphTablesVersion.load()).arg(hb_direction_to_string(props.direction));
+
+  for (unsigned int i = 0; i < featureCount; i++) {
+    char feature[128];
+    hb_feature_to_string(const_cast<hb_feature_t*>(&features[i]), feature, sizeof(feature));
+    suffix.append(':').append(feature);
+  }
+
+  std::vector<Glyphs> paragraphs;
+
+  bool shapedWhole = false;
+
+  int paragraphStart = 0;
+
+  while (paragraphStart < text.size()) {
+
+    int paragraphEnd = text.indexOf(QChar('\n'), paragraphStart);
+    paragraphEnd = paragraphEnd == -1 ? text.size() : paragraphEnd + 1;
+
+    std::vector<Unit> units;
+    splitUnits(text, paragraphStart, paragraphEnd, units);
+
+    std::vector<QString> keys(units.size());
+    for (int i = 0; i < (int)units.size(); i++) {
+      keys[i] = runKey(text, units, i, suffix);
+    }
+
+    paragraphs.push_back({});
+    Glyphs& paragraph = paragraphs.back();
+
+    bool complete = true;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (auto& key : keys) {
+        if (!runs.contains(key)) {
+          complete = false;
+          break;
+        }
+      }
+
+      if (complete) {
+        m_stats.hits += units.size();
+
+        for (int u = 0; u < (int)units.size(); u++) {
+          int index = backward ? units.size() - 1 - u : u;
+          const Run& run = *runs.constFind(keys[index]);
+          for (size_t g = 0; g < run.infos.size(); g++) {
+            hb_glyph_info_t info = run.infos[g];
+            info.cluster += units[index].start;
+            paragraph.infos.push_back(info);
+            paragraph.positions.push_back(run.positions[g]);
+          }
+        }
+      }
+    }
+
+    if (!complete) {
+      hb_buffer_clear_contents(buffer);
+      hb_buffer_set_segment_properties(buffer, &props);
+      hb_buffer_add_utf16(buffer, text.utf16(), text.size(), paragraphStart, paragraphEnd - paragraphStart);
+
+      hb_shape(font, buffer, features, featureCount);
+
+      shapedWhole = paragraphStart == 0 && paragraphEnd == text.size();
+
+      unsigned int count;
+      hb_glyph_info_t* infos = hb_buffer_get_glyph_infos(buffer, &count);
+      hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(buffer, &count);
+
+      paragraph.infos.assign(infos, infos + count);
+      paragraph.positions.assign(positions, positions + count);
+
+      std::vector<Run> newRuns(units.size());
+
+      // a boundary is safe when a cluster starts at it and is not unsafe to break
+      std::vector<bool> startFound(units.size(), false);
+      bool safe = true;
+
+      for (unsigned int g = 0; g < count; g++) {
+        // a glyph belongs to the unit of its cluster
+        auto unit = std::upper_bound(units.begin(), units.end(), (int)infos[g].cluster, [](int cluster, const Unit& unit) {
+          return cluster < unit.start;
+          });
+        int index = std::max(0, (int)(unit - units.begin()) - 1);
+
+        if ((int)infos[g].cluster == units[index].start) {
+          startFound[index] = true;
+          if (index != 0 && (hb_glyph_info_get_glyph_flags(&infos[g]) & HB_GLYPH_FLAG_UNSAFE_TO_BREAK)) {
+            safe = false;
+          }
+        }
+
+        hb_glyph_info_t info = infos[g];
+        info.cluster -= units[index].start;
+
+        newRuns[index].infos.push_back(info);
+        newRuns[index].positions.push_back(positions[g]);
+      }
+
+      // a word merged in the cluster of the previous one has no boundary of its own
+      for (int i = 1; i < (int)units.size() && safe; i++) {
+        safe = startFound[i];
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      m_stats.misses += units.size();
+
+      if (!safe) {
+        // the words of this paragraph are reshaped together next time
+        m_stats.unsafe++;
+      }
+      else {
+        if (m_maxEntries != 0 && runs.size() + (int)units.size() > m_maxEntries) {
+          runs.clear();
+        }
+
+        for (int i = 0; i < (int)units.size(); i++) {
+          runs.insert(keys[i], std::move(newRuns[i]));
+        }
+      }
+    }
+
+    paragraphStart = paragraphEnd;
+  }
+
+  if (backward) {
+    std::reverse(paragraphs.begin(), paragraphs.end());
+  }
+
+  for (auto& paragraph : paragraphs) {
+    result.infos.insert(result.infos.end(), paragraph.infos.begin(), paragraph.infos.end());
+    result.positions.insert(result.positions.end(), paragraph.positions.begin(), paragraph.positions.end());
+  }
+
+  return shapedWhole;
+}
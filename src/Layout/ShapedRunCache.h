@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <QHash>
+#include <QString>
+#include "hb.h"
+
+class OtLayout;
+
+/*
+  Glyph runs of the words of an unjustified text, keyed by the word with its previous and next words.
+  The text is split in paragraphs at the new lines. A paragraph whose words are all cached is assembled from the
+  runs, otherwise it is shaped once with hb_shape. Its words are added to the cache only when hb_shape marks every
+  word boundary safe to break, since a lookup may reach past the neighbouring words; otherwise the paragraph
+  is shaped again the next time.
+*/
+class ShapedRunCache {
+public:
+  struct Glyphs {
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+  };
+
+  struct Stats {
+    quint64 hits = 0;
+    quint64 misses = 0;
+    // paragraphs not cached because a word boundary is unsafe to break
+    quint64 unsafe = 0;
+    size_t entries = 0;
+  };
+
+  explicit ShapedRunCache(OtLayout* layout);
+
+  // shapes text with the segment properties of buffer, the glyphs are in the order of hb_shape and the clusters are offsets in text.
+  // Returns true when text was shaped as a whole by hb_shape, buffer then holds its glyphs.
+  bool shape(hb_font_t* font, hb_buffer_t* buffer, const QString& text, const hb_feature_t* features, unsigned int featureCount, Glyphs& result);
+
+  // the runs are dropped when the number of entries exceeds the limit, 0 = unlimited
+  void setMaxEntries(int maxEntries);
+
+  void clear();
+
+  Stats stats();
+
+private:
+  struct Unit {
+    int start;
+    int length;
+  };
+
+  struct Run {
+    // clusters relative to the start of the unit
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+  };
+
+  void splitUnits(const QString& text, int start, int end, std::vector<Unit>& units) const;
+  QString runKey(const QString& text, const std::vector<Unit>& units, int index, const QString& suffix) const;
+
+  OtLayout* m_layout;
+  std::mutex mutex;
+  QHash<QString, Run> runs;
+  int m_maxEntries = 200000;
+  Stats m_stats;
+};
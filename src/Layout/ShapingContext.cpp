@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "ShapingContext.h"
+#include "hb.h"
+#include <stdexcept>
+
+static hb_user_data_key_t shapingContextKey;
+
+thread_local ShapingContext* ShapingContext::currentContext = nullptr;
+
+static void destroyShapingContext(void* data) {
+  delete static_cast<ShapingContext*>(data);
+}
+
+void ShapingContext::attach(hb_font_t* font, ShapingContext* context) {
+  if (!hb_font_set_user_data(font, &shapingContextKey, context, destroyShapingContext, true)) {
+    delete context;
+    throw new std::runtime_error("Cannot attach the shaping context to the font");
+  }
+}
+
+ShapingContext* ShapingContext::fromFont(hb_font_t* font) {
+  return static_cast<ShapingContext*>(hb_font_get_user_data(font, &shapingContextKey));
+}
+
+ShapingContext* ShapingContext::current() {
+  return currentContext;
+}
+
+ShapingContext::Scope::Scope(ShapingContext* context) : previous{ currentContext } {
+  currentContext = context;
+}
+
+ShapingContext::Scope::~Scope() {
+  currentContext = previous;
+}
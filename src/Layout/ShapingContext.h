@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include "JustificationContext.h"
+
+struct hb_font_t;
+
+/*
+  Mutable state of one shaping run. OtLayout::createFont attaches a new context to the font as user data
+  and the HarfBuzz callbacks get it back from the font they receive, so the layout is only read while shaping
+  and several fonts of the same layout can shape lines concurrently.
+*/
+class ShapingContext {
+public:
+  JustificationContext justification;
+  bool justificationInProgress = false;
+  // copied from OtLayout::applyJustification when the font is created
+  bool applyJustification = true;
+
+  // the font owns the context
+  static void attach(hb_font_t* font, ShapingContext* context);
+  static ShapingContext* fromFont(hb_font_t* font);
+
+  // context of the run shaping on the calling thread, for the code reached without the font such as the anchor functions
+  static ShapingContext* current();
+
+  class Scope {
+  public:
+    explicit Scope(ShapingContext* context);
+    ~Scope();
+  private:
+    ShapingContext* previous;
+  };
+
+private:
+  static thread_local ShapingContext* currentContext;
+};
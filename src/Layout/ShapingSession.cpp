@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#include "ShapingSession.h"
+#include "ShapingContext.h"
+#include "OtLayout.h"
+#include "hb.h"
+
+ShapingSession::ShapingSession(OtLayout* layout) : m_layout{ layout } {
+}
+
+ShapingSession::~ShapingSession() {
+  clear();
+}
+
+hb_font_t* ShapingSession::acquireFont(int emScale, bool newFace) {
+
+  hb_face_t* currentFace = m_layout->updateFace(newFace);
+
+  hb_font_t* font = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (currentFace != face) {
+      clearFonts();
+      face = currentFace;
+    }
+    else {
+      hb_face_destroy(currentFace);
+    }
+
+    auto& pool = fonts[emScale * 1000];
+    if (!pool.empty()) {
+      font = pool.back();
+      pool.pop_back();
+    }
+  }
+
+  if (font == nullptr) {
+    return m_layout->createFont(emScale, false);
+  }
+
+  ShapingContext* context = ShapingContext::fromFont(font);
+  context->justification.clear();
+  context->justificationInProgress = false;
+  context->applyJustification = m_layout->applyJustification;
+
+  return font;
+}
+
+void ShapingSession::releaseFont(hb_font_t* font) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // a font created while another thread replaced the face is not kept
+  if (hb_font_get_face(font) != face) {
+    hb_font_destroy(font);
+    return;
+  }
+
+  int xscale, yscale;
+  hb_font_get_scale(font, &xscale, &yscale);
+
+  fonts[xscale].push_back(font);
+}
+
+hb_buffer_t* ShapingSession::acquireBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!buffers.empty()) {
+      hb_buffer_t* buffer = buffers.back();
+      buffers.pop_back();
+      return buffer;
+    }
+  }
+  return hb_buffer_create();
+}
+
+void ShapingSession::releaseBuffer(hb_buffer_t* buffer) {
+  hb_buffer_reset(buffer);
+  std::lock_guard<std::mutex> lock(mutex);
+  buffers.push_back(buffer);
+}
+
+void ShapingSession::clearFonts() {
+  for (auto& pool : fonts) {
+    for (auto font : pool.second) {
+      hb_font_destroy(font);
+    }
+  }
+  fonts.clear();
+  if (face != nullptr) {
+    hb_face_destroy(face);
+    face = nullptr;
+  }
+}
+
+void ShapingSession::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  clearFonts();
+  for (auto buffer : buffers) {
+    hb_buffer_destroy(buffer);
+  }
+  buffers.clear();
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+struct hb_face_t;
+struct hb_font_t;
+struct hb_buffer_t;
+class OtLayout;
+
+/*
+  Fonts and buffers reused by the shaping calls of a layout. A released font goes back to the pool of its scale
+  and a released buffer is reset, so shaping a page does not create fonts, buffers or faces.
+  Each caller gets its own font, the ShapingContext of a run is never shared between threads.
+  The pooled fonts are dropped when OtLayout::updateFace creates a new face because the lookups changed.
+*/
+class ShapingSession {
+public:
+  explicit ShapingSession(OtLayout* layout);
+  ~ShapingSession();
+
+  ShapingSession(const ShapingSession&) = delete;
+  ShapingSession& operator=(const ShapingSession&) = delete;
+
+  // newFace recreates the face if the lookups changed, see OtLayout::updateFace
+  hb_font_t* acquireFont(int emScale, bool newFace = false);
+  void releaseFont(hb_font_t* font);
+
+  hb_buffer_t* acquireBuffer();
+  void releaseBuffer(hb_buffer_t* buffer);
+
+  void clear();
+
+  class Font {
+  public:
+    Font(ShapingSession& session, int emScale, bool newFace = false) : m_session{ session }, m_font{ session.acquireFont(emScale, newFace) } {}
+    ~Font() { m_session.releaseFont(m_font); }
+    Font(const Font&) = delete;
+    Font& operator=(const Font&) = delete;
+
+    operator hb_font_t* () const { return m_font; }
+  private:
+    ShapingSession& m_session;
+    hb_font_t* m_font;
+  };
+
+  class Buffer {
+  public:
+    explicit Buffer(ShapingSession& session) : m_session{ session }, m_buffer{ session.acquireBuffer() } {}
+    ~Buffer() { m_session.releaseBuffer(m_buffer); }
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    operator hb_buffer_t* () const { return m_buffer; }
+  private:
+    ShapingSession& m_session;
+    hb_buffer_t* m_buffer;
+  };
+
+private:
+  void clearFonts();
+
+  OtLayout* m_layout;
+  std::mutex mutex;
+  // referenced face of the pooled fonts
+  hb_face_t* face = nullptr;
+  // by x scale
+  std::map<int, std::vector<hb_font_t*>> fonts;
+  std::vector<hb_buffer_t*> buffers;
+};
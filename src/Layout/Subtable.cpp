@@ -898,36 +898,34 @@ optional<QPoint> CursiveSubtable::getExit(quint16 glyph_id, double lefttatweel,
 
   optional<QPoint> ret;
 
-  if (anchors.contains(glyph_id)) {
+  // called on the shaping threads, the lookups must not insert in the shared maps
+  auto entryexit = anchors.constFind(glyph_id);
 
-    auto& entryexit = anchors[glyph_id];
+  if (entryexit != anchors.constEnd()) {
 
-    if (entryexit.exit || !entryexit.exitName.isEmpty()) {
+    if (entryexit->exit || !entryexit->exitName.isEmpty()) {
 
       QPoint exit;
 
-      if (entryexit.exit) {
-        exit = *(entryexit.exit);
+      if (entryexit->exit) {
+        exit = *(entryexit->exit);
       }
 
 
-      if (exitParameters.contains(glyph_id)) {
-        exit += exitParameters[glyph_id];
-      }
-      if (lefttatweel != 0.0 || righttatweel != 0.0) {
+      exit += exitParameters.value(glyph_id);
+
+      GlyphVis* originalglyph = m_layout->getGlyph(glyph_id);
+
+      if ((lefttatweel != 0.0 || righttatweel != 0.0) && originalglyph != nullptr) {
         GlyphParameters parameters{};
 
         parameters.lefttatweel = lefttatweel;
         parameters.righttatweel = righttatweel;
 
-        QString glyphName = m_layout->glyphNamePerCode[glyph_id];
-
-        GlyphVis* originalglyph = &m_layout->glyphs[glyphName];
-
         GlyphVis* curr = originalglyph->getAlternate(parameters);
 
-        if (!entryexit.exitName.isEmpty() && curr->conatinsAnchor(entryexit.exitName)) {
-          exit = curr->getAnchor(entryexit.exitName);
+        if (!entryexit->exitName.isEmpty() && curr->conatinsAnchor(entryexit->exitName)) {
+          exit = curr->getAnchor(entryexit->exitName);
         }
         else if (curr->conatinsAnchor(this->name)) {
           exit = curr->getAnchor(this->name);
@@ -947,28 +945,24 @@ optional<QPoint> CursiveSubtable::getEntry(quint16 glyph_id, double lefttatweel,
 
   optional<QPoint> ret;
 
-  if (anchors.contains(glyph_id)) {
+  auto entryexit = anchors.constFind(glyph_id);
 
-    auto& entryexit = anchors[glyph_id];
+  if (entryexit != anchors.constEnd()) {
 
-    if (entryexit.entry) {
+    if (entryexit->entry) {
 
-      QPoint entry{ *(entryexit.entry) };
+      QPoint entry{ *(entryexit->entry) };
 
-      if (entryParameters.contains(glyph_id)) {
-        entry += entryParameters[glyph_id];
-      }
+      entry += entryParameters.value(glyph_id);
+
+      GlyphVis* originalglyph = m_layout->getGlyph(glyph_id);
 
-      if (lefttatweel != 0.0 || righttatweel != 0.0) {
+      if ((lefttatweel != 0.0 || righttatweel != 0.0) && originalglyph != nullptr) {
         GlyphParameters parameters{};
 
         parameters.lefttatweel = lefttatweel;
         parameters.righttatweel = righttatweel;
 
-        QString glyphName = m_layout->glyphNamePerCode[glyph_id];
-
-        GlyphVis* originalglyph = &m_layout->glyphs[glyphName];
-
         GlyphVis* curr = originalglyph->getAlternate(parameters);
 
         if (curr->conatinsAnchor(this->name)) {
@@ -1334,27 +1328,32 @@ void MarkBaseSubtable::readParameters(const QJsonObject& json) {
 
 optional<QPoint> MarkBaseSubtable::getBaseAnchor(quint16 mark_id, quint16 base_id, double lefttatweel, double righttatweel) {
 
-  quint16 classIndex = markCodes[mark_id];
+  // called on the shaping threads, the lookups must not insert in the shared maps
+  quint16 classIndex = markCodes.value(mark_id);
 
-  QString className = classNamebyIndex[classIndex];
+  QString className = classNamebyIndex.value(classIndex);
 
-  QString baseGlyphName = m_layout->glyphNamePerCode[base_id];
+  QString baseGlyphName = m_layout->glyphNamePerCode.value(base_id);
 
   QPoint coordinate;
 
-  auto markClass = classes[className];
+  auto markClass = classes.constFind(className);
 
-  if (markClass.baseparameters.contains(baseGlyphName)) {
-    coordinate = markClass.baseparameters[baseGlyphName];
+  if (markClass == classes.constEnd()) {
+    return coordinate;
   }
 
-  if (markClass.baseanchors.contains(baseGlyphName)) {
-    coordinate += markClass.baseanchors[baseGlyphName];
+  coordinate = markClass->baseparameters.value(baseGlyphName);
+
+  auto baseanchor = markClass->baseanchors.constFind(baseGlyphName);
+
+  if (baseanchor != markClass->baseanchors.constEnd()) {
+    coordinate += baseanchor.value();
   }
   else {
 
-    if (markClass.basefunction) {
-      coordinate = markClass.basefunction(baseGlyphName, className, coordinate, lefttatweel, righttatweel);
+    if (markClass->basefunction) {
+      coordinate = markClass->basefunction(baseGlyphName, className, coordinate, lefttatweel, righttatweel);
     }
   }
 
@@ -1379,29 +1378,31 @@ optional<QPoint> MarkBaseSubtable::getBaseAnchor(quint16 mark_id, quint16 base_i
 }
 optional<QPoint> MarkBaseSubtable::getMarkAnchor(quint16 mark_id, quint16 base_id, double lefttatweel, double righttatweel) {
 
-  quint16 classIndex = markCodes[mark_id];
+  quint16 classIndex = markCodes.value(mark_id);
 
-  QString className = classNamebyIndex[classIndex];
+  QString className = classNamebyIndex.value(classIndex);
 
-  QString baseGlyphName = m_layout->glyphNamePerCode[base_id];
-
-  QString markGlyphName = m_layout->glyphNamePerCode[mark_id];
+  QString markGlyphName = m_layout->glyphNamePerCode.value(mark_id);
 
   QPoint coordinate;
 
-  auto markClass = classes[className];
+  auto markClass = classes.constFind(className);
 
-  if (markClass.markparameters.contains(markGlyphName)) {
-    coordinate = markClass.markparameters[markGlyphName];
+  if (markClass == classes.constEnd()) {
+    return coordinate;
   }
 
-  if (markClass.markanchors.contains(markGlyphName)) {
-    coordinate += markClass.markanchors[markGlyphName];
+  coordinate = markClass->markparameters.value(markGlyphName);
+
+  auto markanchor = markClass->markanchors.constFind(markGlyphName);
+
+  if (markanchor != markClass->markanchors.constEnd()) {
+    coordinate += markanchor.value();
   }
   else {
 
-    if (markClass.markfunction != nullptr) {
-      coordinate = markClass.markfunction(markGlyphName, className, coordinate, lefttatweel, righttatweel);
+    if (markClass->markfunction != nullptr) {
+      coordinate = markClass->markfunction(markGlyphName, className, coordinate, lefttatweel, righttatweel);
     }
   }
 
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#include "TableBlobStore.h"
+#include "hb.h"
+
+static void destroyTableData(void* data) {
+  delete static_cast<QByteArray*>(data);
+}
+
+TableBlobStore::~TableBlobStore() {
+  clear();
+}
+
+hb_blob_t* TableBlobStore::reference(quint32 tag, quint64 version, const Builder& build) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = entries.find(tag);
+
+  if (it != entries.end()) {
+    if (it->second.version == version) {
+      return hb_blob_reference(it->second.blob);
+    }
+    // the faces using the previous table keep their reference
+    hb_blob_destroy(it->second.blob);
+    entries.erase(it);
+  }
+
+  QByteArray* data = new QByteArray(build());
+
+  hb_blob_t* blob = hb_blob_create(data->constData(), data->size(), HB_MEMORY_MODE_READONLY, data, destroyTableData);
+
+  entries.insert({ tag, Entry{ version, blob } });
+
+  return hb_blob_reference(blob);
+}
+
+void TableBlobStore::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto& entry : entries) {
+    hb_blob_destroy(entry.second.blob);
+  }
+  entries.clear();
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <QByteArray>
+
+struct hb_blob_t;
+
+/*
+  Tables given to HarfBuzz by harfbuzzGetTables. A table is serialized once per content version and shared
+  read-only with every face asking for it, the blob holds a reference to the QByteArray instead of a copy.
+*/
+class TableBlobStore {
+public:
+  typedef std::function<QByteArray()> Builder;
+
+  ~TableBlobStore();
+
+  // referenced blob of the table, build is only called if the stored blob has another version
+  hb_blob_t* reference(quint32 tag, quint64 version, const Builder& build);
+
+  void clear();
+
+private:
+  struct Entry {
+    quint64 version;
+    hb_blob_t* blob;
+  };
+
+  std::mutex mutex;
+  std::unordered_map<quint32, Entry> entries;
+};
@@ -24,6 +24,8 @@
 #include "qdatetime.h"
 #include "OtLayout.h"
 #include "GlyphVis.h"
+#include "AlternateLruCache.h"
+#include "GlyphMetricsCache.h"
 #include "automedina/automedina.h"
 #include <stdexcept>
 
@@ -236,8 +238,6 @@ void ToOpenType::setGIds() {
   QMap<quint16, QString> glyphNamePerCode;
   QMap<quint16, quint16> unicodeToGlyphCode;
   QMap<quint16, OtLayout::GDEFClasses> glyphGlobalClasses;
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> alternatePaths;
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> nojustalternatePaths;
 
   if (!ot_layout->glyphs.contains("notdef")) {
     throw new std::runtime_error("notdef glyph not found");
@@ -313,23 +313,8 @@ void ToOpenType::setGIds() {
   }
 
 
-  for (std::pair<int, std::unordered_map<GlyphParameters, GlyphVis*>> element : ot_layout->alternatePaths)
-  {
-    if (!newCodes.contains(element.first)) {
-      throw new std::runtime_error(QString("Code %1 not found").arg(element.first).toStdString());
-    }
-
-    alternatePaths.insert({ newCodes.value(element.first), element.second });
-  }
-
-  for (std::pair<int, std::unordered_map<GlyphParameters, GlyphVis*>> element : ot_layout->nojustalternatePaths)
-  {
-    if (!newCodes.contains(element.first)) {
-      throw new std::runtime_error(QString("Code %1 not found").arg(element.first).toStdString());
-    }
-
-    nojustalternatePaths.insert({ newCodes.value(element.first), element.second });
-  }
+  ot_layout->alternates->remapCodes(newCodes);
+  ot_layout->metricsCache->clear();
 
   for (int i = 0; i <= 4; i++) {
     auto automedina = ot_layout->automedina;
@@ -361,10 +346,12 @@ void ToOpenType::setGIds() {
   ot_layout->glyphCodePerName = glyphCodePerName;
   ot_layout->glyphNamePerCode = glyphNamePerCode;
   ot_layout->unicodeToGlyphCode = unicodeToGlyphCode;
-  ot_layout->alternatePaths = alternatePaths;
-  ot_layout->nojustalternatePaths = nojustalternatePaths;
   ot_layout->glyphGlobalClasses = glyphGlobalClasses;
 
+  ot_layout->updateGlyphTable();
+  ot_layout->dirty = true;
+  ot_layout->glyphTablesVersion++;
+
 
 
 }
@@ -928,23 +915,30 @@ QByteArray ToOpenType::post() {
 
   return data;
 }
-void ToOpenType::dumpPath(QByteArray& data, mp_fill_object* fill, double& currentx, double& currenty, PathLimits& pathLimits) {
-
-  auto path = fill->path_p;
+void ToOpenType::dumpPath(QByteArray& data, const GlyphOutline& outline, const GlyphOutline::Contour& contour, double& currentx, double& currenty, PathLimits& pathLimits) {
 
-  mp_gr_knot p, q;
+  int p, q;
   PathLimits pLimits, qLimits;
 
-  if (path == nullptr) return;
+  if (contour.size == 0) return;
 
-  double defaultt = path->x_coord - currentx;
+  auto& x = outline.x;
+  auto& y = outline.y;
+  auto& left_x = outline.leftX;
+  auto& left_y = outline.leftY;
+  auto& right_x = outline.rightX;
+  auto& right_y = outline.rightY;
+
+  int first = contour.first;
+
+  double defaultt = x[first] - currentx;
   fixed_to_cff2(data, defaultt);
   if (isCff2) {
     auto delta = pathLimits.x_coord() - pathLimits.currentx - defaultt;
     data.append(blend(delta, pathLimits.limits));
   }
 
-  defaultt = path->y_coord - currenty;
+  defaultt = y[first] - currenty;
   fixed_to_cff2(data, defaultt);
   if (isCff2) {
     auto delta = pathLimits.y_coord() - pathLimits.currenty - defaultt;
@@ -953,48 +947,48 @@ void ToOpenType::dumpPath(QByteArray& data, mp_fill_object* fill, double& curren
 
   data << (uint8_t)21; // rmoveto;
 
-  p = path;
+  p = first;
   pLimits = pathLimits;
   do {
-    q = p->next;
+    q = outline.next(contour, p);
     qLimits = pLimits.next();
 
-    defaultt = p->right_x - p->x_coord;
+    defaultt = right_x[p] - x[p];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto deltax = pLimits.right_x() - pLimits.x_coord() - defaultt;
       data.append(blend(deltax, pathLimits.limits));
     }
 
-    defaultt = p->right_y - p->y_coord;
+    defaultt = right_y[p] - y[p];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto deltay = pLimits.right_y() - pLimits.y_coord() - defaultt;
       data.append(blend(deltay, pathLimits.limits));
     }
 
-    defaultt = q->left_x - p->right_x;
+    defaultt = left_x[q] - right_x[p];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto delta = qLimits.left_x() - pLimits.right_x() - defaultt;
       data.append(blend(delta, pathLimits.limits));
     }
 
-    defaultt = q->left_y - p->right_y;
+    defaultt = left_y[q] - right_y[p];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto delta = qLimits.left_y() - pLimits.right_y() - defaultt;
       data.append(blend(delta, pathLimits.limits));
     }
 
-    defaultt = q->x_coord - q->left_x;
+    defaultt = x[q] - left_x[q];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto delta = qLimits.x_coord() - qLimits.left_x() - defaultt;
       data.append(blend(delta, pathLimits.limits));
     }
 
-    defaultt = q->y_coord - q->left_y;
+    defaultt = y[q] - left_y[q];
     fixed_to_cff2(data, defaultt);
     if (isCff2) {
       auto delta = qLimits.y_coord() - qLimits.left_y() - defaultt;
@@ -1007,10 +1001,10 @@ void ToOpenType::dumpPath(QByteArray& data, mp_fill_object* fill, double& curren
 
     p = q;
     pLimits = qLimits;
-  } while (p != path);
+  } while (p != first);
 
-  currentx = p->x_coord;
-  currenty = p->y_coord;
+  currentx = x[p];
+  currenty = y[p];
   if (isCff2) {
     pathLimits.currentx = pLimits.x_coord();
     pathLimits.currenty = pLimits.y_coord();
@@ -1022,7 +1016,7 @@ void ToOpenType::dumpPath(QByteArray& data, mp_fill_object* fill, double& curren
   }
 
 }
-QByteArray ToOpenType::charString(mp_graphic_object* body, bool iscff2, QVector<Layer>& layers, double& currentx, double& currenty, ToOpenType::ContourLimits contourLimits) {
+QByteArray ToOpenType::charString(const GlyphOutline& outline, bool iscff2, QVector<Layer>& layers, double& currentx, double& currenty, ToOpenType::ContourLimits contourLimits) {
 
 
   QByteArray data;
@@ -1031,55 +1025,45 @@ QByteArray ToOpenType::charString(mp_graphic_object* body, bool iscff2, QVector<
   PathLimits pathlimits;
   pathlimits.limits = contourLimits.limits;
 
-  if (body) {
-    do {
-      switch (body->type)
-      {
-      case mp_fill_code: {
-        QByteArray layerArray;
-        mp_fill_object* fillobject = (mp_fill_object*)body;
-
-
-        if (iscff2) {
-          pathlimits.maxLeft = contourLimits.maxLeft != nullptr ? ((mp_fill_object*)contourLimits.maxLeft)->path_p : nullptr;
-          pathlimits.minLeft = contourLimits.minLeft != nullptr ? ((mp_fill_object*)contourLimits.minLeft)->path_p : nullptr;
-          pathlimits.maxRight = contourLimits.maxRight != nullptr ? ((mp_fill_object*)contourLimits.maxRight)->path_p : nullptr;
-          pathlimits.minRight = contourLimits.minRight != nullptr ? ((mp_fill_object*)contourLimits.minRight)->path_p : nullptr;
-        }
-
-
-        dumpPath(layerArray, fillobject, currentx, currenty, pathlimits);
-        if (layerArray.size() != 0) {
-          data.append(layerArray);
-          Layer layer;
-          QByteArray newGlyphArray;
-          double tempx = 0;
-          double tempy = 0;
-          PathLimits tempPathLimits;
-          dumpPath(newGlyphArray, fillobject, tempx, tempy, tempPathLimits);
-          layer.charString = newGlyphArray;
-          if (fillobject->color_model == mp_rgb_model) {
-            layer.color.red = toInt(fillobject->color.a_val * 255);
-            layer.color.green = toInt(fillobject->color.b_val * 255);
-            layer.color.blue = toInt(fillobject->color.c_val * 255);
-          }
-          layers.append(layer);
-        }
+  // a master is used for the contour only if it has the contour
+  auto master = [](const std::shared_ptr<const GlyphOutline>& masterOutline, int contourIndex) -> const GlyphOutline* {
+    if (masterOutline == nullptr || contourIndex >= (int)masterOutline->contours.size() || masterOutline->contours[contourIndex].size == 0) {
+      return nullptr;
+    }
+    return masterOutline.get();
+  };
 
-        break;
-      }
-      default:
-        break;
-      }
-      body = body->next;
-      if (iscff2) {
-        contourLimits.maxLeft = contourLimits.maxLeft != nullptr ? contourLimits.maxLeft->next : nullptr;
-        contourLimits.minLeft = contourLimits.minLeft != nullptr ? contourLimits.minLeft->next : nullptr;
-        contourLimits.maxRight = contourLimits.maxRight != nullptr ? contourLimits.maxRight->next : nullptr;
-        contourLimits.minRight = contourLimits.minRight != nullptr ? contourLimits.minRight->next : nullptr;
+  for (int contourIndex = 0; contourIndex < (int)outline.contours.size(); contourIndex++) {
+    auto& contour = outline.contours[contourIndex];
+
+    QByteArray layerArray;
+
+    if (iscff2) {
+      pathlimits.maxLeft = master(contourLimits.maxLeft, contourIndex);
+      pathlimits.minLeft = master(contourLimits.minLeft, contourIndex);
+      pathlimits.maxRight = master(contourLimits.maxRight, contourIndex);
+      pathlimits.minRight = master(contourLimits.minRight, contourIndex);
+      pathlimits.contour = contourIndex;
+      pathlimits.index = 0;
+    }
+
+    dumpPath(layerArray, outline, contour, currentx, currenty, pathlimits);
+    if (layerArray.size() != 0) {
+      data.append(layerArray);
+      Layer layer;
+      QByteArray newGlyphArray;
+      double tempx = 0;
+      double tempy = 0;
+      PathLimits tempPathLimits;
+      dumpPath(newGlyphArray, outline, contour, tempx, tempy, tempPathLimits);
+      layer.charString = newGlyphArray;
+      if (contour.hasColor) {
+        layer.color.red = toInt(contour.red * 255);
+        layer.color.green = toInt(contour.green * 255);
+        layer.color.blue = toInt(contour.blue * 255);
       }
-
-    } while (body != nullptr);
+      layers.append(layer);
+    }
   }
 
   return data;
@@ -1123,6 +1107,9 @@ QByteArray ToOpenType::charStrings(bool iscff2) {
 
         if (ff != ot_layout->expandableGlyphs.end()) {
 
+          // the masters are read before the next glyph may evict them
+          OtLayout::PinnedAlternates pinned{ ot_layout };
+
           auto& jj = ff->second;
           contourLimits.limits = jj;
 
@@ -1140,7 +1127,7 @@ QByteArray ToOpenType::charStrings(bool iscff2) {
             parameters.righttatweel = 0.0;
 
             auto alternate = glyph.getAlternate(parameters);
-            contourLimits.maxLeft = alternate->copiedPath;
+            contourLimits.maxLeft = alternate->outline();
 
           }
           if (jj.minLeft != 0) {
@@ -1150,7 +1137,7 @@ QByteArray ToOpenType::charStrings(bool iscff2) {
             parameters.righttatweel = 0.0;
 
             auto alternate = glyph.getAlternate(parameters);
-            contourLimits.minLeft = alternate->copiedPath;
+            contourLimits.minLeft = alternate->outline();
 
           }
           if (jj.maxRight != 0) {
@@ -1160,7 +1147,7 @@ QByteArray ToOpenType::charStrings(bool iscff2) {
             parameters.righttatweel = jj.maxRight;
 
             auto alternate = glyph.getAlternate(parameters);
-            contourLimits.maxRight = alternate->copiedPath;
+            contourLimits.maxRight = alternate->outline();
 
           }
           if (jj.minRight != 0) {
@@ -1170,11 +1157,11 @@ QByteArray ToOpenType::charStrings(bool iscff2) {
             parameters.righttatweel = jj.minRight;
 
             auto alternate = glyph.getAlternate(parameters);
-            contourLimits.minRight = alternate->copiedPath;
+            contourLimits.minRight = alternate->outline();
 
           }
         }
-        glyphData = charString(glyph.copiedPath, iscff2, layers, currentx, currenty, contourLimits);
+        glyphData = charString(*glyph.outline(), iscff2, layers, currentx, currenty, contourLimits);
       }
 
       bool needColor = false;
@@ -1726,40 +1713,23 @@ QByteArray ToOpenType::getAyaMono() {
 
   GlyphVis& endofaya = ot_layout->glyphs["endofaya"];
 
-  QByteArray endofayaArray = charString(endofaya.copiedPath, this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
-
-  auto monoPath = (mp_fill_object*)mp_new_graphic_object(ot_layout->mp, mp_fill_code);
-
-
-  auto source = endofaya.copiedPath->next;
-  auto dest = monoPath;
-  dest->path_p = ((mp_fill_object*)endofaya.copiedPath)->path_p;
+  QByteArray endofayaArray = charString(*endofaya.outline(), this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
 
-  int pathIndex = 1;
-
-  do {
-    if (source->type == mp_fill_code && pathIndex != 6 && pathIndex != 7 && pathIndex != 8 && pathIndex != 9) {
-      auto newpath = (mp_fill_object*)mp_new_graphic_object(ot_layout->mp, mp_fill_code);
-      newpath->path_p = ((mp_fill_object*)source)->path_p;
-      dest->next = (mp_graphic_object*)newpath;
-      dest = newpath;
+  // the monochrome version does not have the contours 6 to 9
+  std::vector<int> monoContours;
+  auto endofayaOutline = endofaya.outline();
+  for (int contourIndex = 0; contourIndex < (int)endofayaOutline->contours.size(); contourIndex++) {
+    if (contourIndex < 6 || contourIndex > 9) {
+      monoContours.push_back(contourIndex);
     }
-    source = source->next;
-    pathIndex++;
+  }
 
-  } while (source != nullptr);
+  GlyphOutline monoOutline(*endofayaOutline, monoContours);
 
   endofayax = 0.0;
   endofayay = 0.0;
 
-  QByteArray endofayaMonoArray = charString((mp_graphic_object*)monoPath, this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
-
-
-  while (monoPath != nullptr) {
-    auto q = monoPath->next;
-    free(monoPath);
-    monoPath = (mp_fill_object*)q;
-  }
+  QByteArray endofayaMonoArray = charString(monoOutline, this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
 
   return endofayaMonoArray;
 
@@ -1773,7 +1743,7 @@ void ToOpenType::setAyaGlyphPaths() {
   double endofayax = 0.0;
   double endofayay = 0.0;
 
-  QByteArray endofayaArray = charString(endofaya.copiedPath, this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
+  QByteArray endofayaArray = charString(*endofaya.outline(), this->isCff2, ayaLayers, endofayax, endofayay, ContourLimits{});
 
   QByteArray endofayaMonoArray = getAyaMono();
 
@@ -1793,7 +1763,7 @@ void ToOpenType::setAyaGlyphPaths() {
     double currenty = 0.0;
 
     auto digit = glyphs[ot_layout->unicodeToGlyphCode.value(0x0660 + i)];
-    QByteArray charStringArray = charString(digit->copiedPath, this->isCff2, layers, currentx, currenty, ContourLimits{});
+    QByteArray charStringArray = charString(*digit->outline(), this->isCff2, layers, currentx, currenty, ContourLimits{});
     charStringArray << (uint8_t)11; // return
     subrByGlyph.insert(digit->charcode, subrOffsets.size());
     subrOffsets.append(subrs.size() + 1);
@@ -1819,7 +1789,7 @@ void ToOpenType::setAyaGlyphPaths() {
       double currentx = 0.0;
       double currenty = 0.0;
 
-      QByteArray oneDigitArray = charString(onesglyph->copiedPath, this->isCff2, layers, currentx, currenty, ContourLimits{});
+      QByteArray oneDigitArray = charString(*onesglyph->outline(), this->isCff2, layers, currentx, currenty, ContourLimits{});
       charStringArray.append(oneDigitArray);
 
 
@@ -1866,8 +1836,8 @@ void ToOpenType::setAyaGlyphPaths() {
       double lasty = 0.0;
       double currentx = 0.0;
       double currenty = 0.0;
-      QByteArray onesDigitArray = charString(onesglyph->copiedPath, this->isCff2, layers, currentx, currenty, ContourLimits{});
-      QByteArray tensDigitArray = charString(tensglyph->copiedPath, this->isCff2, layers, lastx, lasty, ContourLimits{});
+      QByteArray onesDigitArray = charString(*onesglyph->outline(), this->isCff2, layers, currentx, currenty, ContourLimits{});
+      QByteArray tensDigitArray = charString(*tensglyph->outline(), this->isCff2, layers, lastx, lasty, ContourLimits{});
 
       QByteArray addDigitArray;
       fixed_to_cff2(addDigitArray, position);
@@ -1925,9 +1895,9 @@ void ToOpenType::setAyaGlyphPaths() {
       double hundredsy = 0.0;
       double currentx = 0.0;
       double currenty = 0.0;
-      QByteArray onesDigitArray = charString(onesglyph->copiedPath, this->isCff2, layers, currentx, currenty, ContourLimits{});
-      QByteArray tensDigitArray = charString(tensglyph->copiedPath, this->isCff2, layers, tensx, tensy, ContourLimits{});
-      QByteArray hundredsDigitArray = charString(hundredsglyph->copiedPath, this->isCff2, layers, hundredsx, hundredsy, ContourLimits{});
+      QByteArray onesDigitArray = charString(*onesglyph->outline(), this->isCff2, layers, currentx, currenty, ContourLimits{});
+      QByteArray tensDigitArray = charString(*tensglyph->outline(), this->isCff2, layers, tensx, tensy, ContourLimits{});
+      QByteArray hundredsDigitArray = charString(*hundredsglyph->outline(), this->isCff2, layers, hundredsx, hundredsy, ContourLimits{});
 
       QByteArray addDigitArray;
       fixed_to_cff2(addDigitArray, position);
@@ -2194,6 +2164,8 @@ QByteArray ToOpenType::HVAR() {
 
       if (ff != ot_layout->expandableGlyphs.end()) {
 
+        OtLayout::PinnedAlternates pinned{ ot_layout };
+
         DefaultDelta advanceDelta;
         DefaultDelta lsbDelta;
 
@@ -2359,6 +2331,7 @@ QByteArray ToOpenType::HVAR_Old() {
       DefaultDelta lsbDelta;
 
       if (ff != ot_layout->expandableGlyphs.end()) {
+        OtLayout::PinnedAlternates pinned{ ot_layout };
         entryExist = true;
         auto& jj = ff->second;
         if (jj.maxLeft != 0) {
@@ -2507,37 +2480,36 @@ QByteArray ToOpenType::HVAR_Old() {
 inline ToOpenType::PathLimits ToOpenType::PathLimits::next()
 {
   PathLimits nn{};
-  if (maxLeft != nullptr) {
-    nn.maxLeft = maxLeft->next;
-  }
-  if (minLeft != nullptr) {
-    nn.minLeft = minLeft->next;
-  }
-  if (maxRight != nullptr) {
-    nn.maxRight = maxRight->next;
-  }
-  if (minRight != nullptr) {
-    nn.minRight = minRight->next;
-  }
+  nn.maxLeft = maxLeft;
+  nn.minLeft = minLeft;
+  nn.maxRight = maxRight;
+  nn.minRight = minRight;
+  nn.contour = contour;
+  nn.index = index + 1;
   return nn;
 }
 
+inline int ToOpenType::PathLimits::knot(const GlyphOutline* outline) {
+  auto& masterContour = outline->contours[contour];
+  return masterContour.first + index % masterContour.size;
+}
+
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::x_coord() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->x_coord;
+    nn.deltas[0] = maxLeft->x[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->x_coord;
+    nn.deltas[1] = minLeft->x[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->x_coord;
+    nn.deltas[2] = maxRight->x[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->x_coord;
+    nn.deltas[3] = minRight->x[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
@@ -2545,19 +2517,19 @@ inline ToOpenType::DeltaValues ToOpenType::PathLimits::x_coord() {
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::y_coord() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->y_coord;
+    nn.deltas[0] = maxLeft->y[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->y_coord;
+    nn.deltas[1] = minLeft->y[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->y_coord;
+    nn.deltas[2] = maxRight->y[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->y_coord;
+    nn.deltas[3] = minRight->y[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
@@ -2565,19 +2537,19 @@ inline ToOpenType::DeltaValues ToOpenType::PathLimits::y_coord() {
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::left_x() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->left_x;
+    nn.deltas[0] = maxLeft->leftX[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->left_x;
+    nn.deltas[1] = minLeft->leftX[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->left_x;
+    nn.deltas[2] = maxRight->leftX[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->left_x;
+    nn.deltas[3] = minRight->leftX[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
@@ -2585,19 +2557,19 @@ inline ToOpenType::DeltaValues ToOpenType::PathLimits::left_x() {
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::left_y() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->left_y;
+    nn.deltas[0] = maxLeft->leftY[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->left_y;
+    nn.deltas[1] = minLeft->leftY[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->left_y;
+    nn.deltas[2] = maxRight->leftY[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->left_y;
+    nn.deltas[3] = minRight->leftY[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
@@ -2605,19 +2577,19 @@ inline ToOpenType::DeltaValues ToOpenType::PathLimits::left_y() {
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::right_x() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->right_x;
+    nn.deltas[0] = maxLeft->rightX[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->right_x;
+    nn.deltas[1] = minLeft->rightX[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->right_x;
+    nn.deltas[2] = maxRight->rightX[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->right_x;
+    nn.deltas[3] = minRight->rightX[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
@@ -2625,19 +2597,19 @@ inline ToOpenType::DeltaValues ToOpenType::PathLimits::right_x() {
 inline ToOpenType::DeltaValues ToOpenType::PathLimits::right_y() {
   DeltaValues nn{};
   if (maxLeft != nullptr) {
-    nn.deltas[0] = maxLeft->right_y;
+    nn.deltas[0] = maxLeft->rightY[knot(maxLeft)];
     nn.active[0] = true;
   }
   if (minLeft != nullptr) {
-    nn.deltas[1] = minLeft->right_y;
+    nn.deltas[1] = minLeft->rightY[knot(minLeft)];
     nn.active[1] = true;
   }
   if (maxRight != nullptr) {
-    nn.deltas[2] = maxRight->right_y;
+    nn.deltas[2] = maxRight->rightY[knot(maxRight)];
     nn.active[2] = true;
   }
   if (minRight != nullptr) {
-    nn.deltas[3] = minRight->right_y;
+    nn.deltas[3] = minRight->rightY[knot(minRight)];
     nn.active[3] = true;
   }
   return nn;
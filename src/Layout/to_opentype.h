@@ -25,6 +25,8 @@
 #include "qmap.h"
 #include "qstring.h"
 #include "commontypes.h"
+#include "GlyphOutline.h"
+#include <memory>
 
 class OtLayout;
 class GlyphVis;
@@ -197,10 +199,10 @@ public:
   }
 
   struct ContourLimits {
-    mp_graphic_object* maxLeft = nullptr;
-    mp_graphic_object* minLeft = nullptr;
-    mp_graphic_object* maxRight = nullptr;
-    mp_graphic_object* minRight = nullptr;
+    std::shared_ptr<const GlyphOutline> maxLeft;
+    std::shared_ptr<const GlyphOutline> minLeft;
+    std::shared_ptr<const GlyphOutline> maxRight;
+    std::shared_ptr<const GlyphOutline> minRight;
     ValueLimits limits;
   };
 
@@ -210,12 +212,17 @@ public:
     ValueLimits limits;
     DeltaValues currentx;
     DeltaValues currenty;
-    mp_gr_knot maxLeft = nullptr;
-    mp_gr_knot minLeft = nullptr;
-    mp_gr_knot maxRight = nullptr;
-    mp_gr_knot minRight = nullptr;
+    // the masters are null when they do not have the contour
+    const GlyphOutline* maxLeft = nullptr;
+    const GlyphOutline* minLeft = nullptr;
+    const GlyphOutline* maxRight = nullptr;
+    const GlyphOutline* minRight = nullptr;
+    int contour = 0;
+    // knot position in the contour
+    int index = 0;
 
     inline PathLimits next();
+    inline int knot(const GlyphOutline* outline);
     inline DeltaValues x_coord();
     inline DeltaValues y_coord();
     inline DeltaValues left_x();
@@ -321,7 +328,7 @@ private:
   void int_to_cff2(QByteArray& cff, int val);
   void fixed_to_cff2(QByteArray& cff, double val);
   QByteArray charStrings(bool iscff2);
-  QByteArray charString(mp_graphic_object* object, bool iscff2, QVector<Layer>& layers, double& currentx, double& currenty, ContourLimits contourLimits);
+  QByteArray charString(const GlyphOutline& outline, bool iscff2, QVector<Layer>& layers, double& currentx, double& currenty, ContourLimits contourLimits);
   void initiliazeGlobals(); 
 
   int nbSubrs = 0;
@@ -333,7 +340,7 @@ private:
   QMap<uint16_t, int> subrByGlyph;
   QMap<uint16_t, QByteArray> replacedGlyphs;
 
-  void dumpPath(QByteArray& data, mp_fill_object* fill, double& currentx, double& currenty, PathLimits& pathLimits);
+  void dumpPath(QByteArray& data, const GlyphOutline& outline, const GlyphOutline::Contour& contour, double& currentx, double& currenty, PathLimits& pathLimits);
 
   QByteArray getSubrs();
   QByteArray getAyaMono();
@@ -2822,7 +2822,17 @@ void Automedina::addchar(QString macroname,
   optional<double> left_tatweeltension,
   optional<double> right_tatweeltension,
   QString newname,
-  optional<int> which_in_baseline) {
+  optional<int> which_in_baseline,
+  MP instance) {
+
+  if (instance == nullptr) {
+    instance = mp;
+  }
+
+  // already in the edges file the instance was loaded from
+  if (mp_has_deferred_input(instance) && mp_find_edge_by_name(instance, newname.toLatin1().constData()) != nullptr) {
+    return;
+  }
 
   QString metapostcode = QString("beginchar(%1,%2,-1,-1,-1);").arg(newname).arg(charcode);
 
@@ -2851,9 +2861,9 @@ void Automedina::addchar(QString macroname,
 
   QByteArray commandBytes = metapostcode.toLatin1();
 
-  int status = mp_execute(mp, commandBytes.data(), commandBytes.size());
+  int status = mp_execute(instance, commandBytes.data(), commandBytes.size());
   if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
-    mp_run_data* results = mp_rundata(mp);
+    mp_run_data* results = mp_rundata(instance);
     QString ret(results->term_out.data);
     ret.trimmed();
     qDebug() << "Metapost error" << ret;
@@ -2865,5 +2875,102 @@ void Automedina::addchar(QString macroname,
 
 
 }
+mp_symbol_entry* Automedina::getGlyphMacro(MP instance, QString macroname) {
+
+  std::lock_guard<std::mutex> lock(glyphMacrosMutex);
+
+  auto key = qMakePair(instance, macroname);
+  auto it = glyphMacros.find(key);
+  if (it != glyphMacros.end()) {
+    return it.value();
+  }
+
+  mp_glyph_macro glyphMacro = mp_prepare_glyph_macro(instance, macroname.toLatin1().constData(), "alternatechar");
+  if (glyphMacro == nullptr) {
+    mp_run_data* results = mp_rundata(instance);
+    qDebug() << "Metapost error" << QString(results->term_out.data).trimmed();
+    return nullptr;
+  }
+  glyphMacros.insert(key, glyphMacro);
+
+  return glyphMacro;
+}
+
+void Automedina::forgetInstance(MP instance) {
+
+  std::lock_guard<std::mutex> lock(glyphMacrosMutex);
+
+  for (auto it = glyphMacros.begin(); it != glyphMacros.end();) {
+    if (it.key().first == instance) {
+      it = glyphMacros.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+static GlyphMacroParameters toMacroParameters(int charcode, const GlyphParameters& parameters) {
+
+  GlyphMacroParameters macroParameters{};
+
+  macroParameters.charcode = charcode;
+  macroParameters.lefttatweel = parameters.lefttatweel;
+  macroParameters.righttatweel = parameters.righttatweel;
+  macroParameters.has_leftextratio = parameters.leftextratio.has_value();
+  macroParameters.leftextratio = parameters.leftextratio.value_or(0);
+  macroParameters.has_rightextratio = parameters.rightextratio.has_value();
+  macroParameters.rightextratio = parameters.rightextratio.value_or(0);
+  macroParameters.has_left_tatweeltension = parameters.left_tatweeltension.has_value();
+  macroParameters.left_tatweeltension = parameters.left_tatweeltension.value_or(0);
+  macroParameters.has_right_tatweeltension = parameters.right_tatweeltension.has_value();
+  macroParameters.right_tatweeltension = parameters.right_tatweeltension.value_or(0);
+  macroParameters.has_which_in_baseline = parameters.which_in_baseline.has_value();
+  macroParameters.which_in_baseline = parameters.which_in_baseline.value_or(0);
+
+  return macroParameters;
+}
+
+mp_edge_object* Automedina::instantiateAlternate(MP instance, QString macroname, int charcode, const GlyphParameters& parameters) {
+
+  mp_glyph_macro glyphMacro = getGlyphMacro(instance, macroname);
+
+  if (glyphMacro == nullptr) {
+    return nullptr;
+  }
+
+  GlyphMacroParameters macroParameters = toMacroParameters(charcode, parameters);
+
+  mp_edge_object* edge = mp_instantiate_glyph_macro(instance, glyphMacro, &macroParameters);
+
+  if (edge == nullptr) {
+    mp_run_data* results = mp_rundata(instance);
+    qDebug() << "Metapost error" << QString(results->term_out.data).trimmed();
+  }
+
+  return edge;
+}
+
+QVector<mp_edge_object*> Automedina::instantiateAlternates(MP instance, const QVector<QPair<QString, GlyphParameters>>& alternates, int firstCharcode) {
+
+  QVector<mp_glyph_macro> macros;
+  QVector<GlyphMacroParameters> macroParameters;
+
+  for (int i = 0; i < alternates.size(); i++) {
+    macros.append(getGlyphMacro(instance, alternates[i].first));
+    macroParameters.append(toMacroParameters(firstCharcode + i, alternates[i].second));
+  }
+
+  QVector<mp_edge_object*> edges(alternates.size());
+
+  int generated = mp_instantiate_glyph_macros(instance, alternates.size(), macros.constData(), macroParameters.constData(), edges.data());
+
+  if (generated != alternates.size()) {
+    mp_run_data* results = mp_rundata(instance);
+    qDebug() << "Metapost error" << QString(results->term_out.data).trimmed();
+  }
+
+  return edges;
+}
 
 
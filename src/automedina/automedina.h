@@ -24,8 +24,11 @@
 #include <optional>
 #include "qpoint.h"
 #include "OtLayout.h"
+#include <mutex>
 
 class LayoutWindow;
+struct mp_edge_object;
+struct mp_symbol_entry;
 
 class Automedina {
 	friend class OtLayout;
@@ -92,7 +95,13 @@ private:
 		std::optional<double> left_tatweeltension,
 		std::optional<double> right_tatweeltension,
 		QString newname,
-		std::optional<int> which_in_baseline);
+		std::optional<int> which_in_baseline,
+		MP instance = nullptr);
+	mp_edge_object* instantiateAlternate(MP instance, QString macroname, int charcode, const GlyphParameters& parameters);
+	// generates the alternates in one MetaPost run with the charcodes firstCharcode, firstCharcode + 1, ...
+	QVector<mp_edge_object*> instantiateAlternates(MP instance, const QVector<QPair<QString, GlyphParameters>>& alternates, int firstCharcode);
+	// drops the glyph macros prepared on the instance, must be called before it is finished
+	void forgetInstance(MP instance);
 	void addchars();
 	void generateGlyphs();
 	QMap<QString, QSet<quint16>> cachedClasstoUnicode;
@@ -112,4 +121,9 @@ private:
 
 	 bool extended;
 
+private:
+	mp_symbol_entry* getGlyphMacro(MP instance, QString macroname);
+	std::mutex glyphMacrosMutex;
+	QHash<QPair<MP, QString>, mp_symbol_entry*> glyphMacros;
+
 };
@@ -29,7 +29,11 @@ public:
   Defaulbaseanchorfortop(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -95,7 +99,11 @@ public:
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -171,7 +179,11 @@ class Defaultopmarkanchor : public AnchorCalc {
 public:
   Defaultopmarkanchor(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     auto ori_width = curr->width;
 
@@ -212,7 +224,11 @@ public:
   Defaullowmarkanchor(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -245,7 +261,13 @@ public:
   Defaultmarkabovemark(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis& curr = _y.glyphs[glyphName];
+    GlyphVis* glyph = getGlyph(_y, glyphName);
+
+    if (glyph == nullptr) {
+      return adjust;
+    }
+
+    GlyphVis& curr = *glyph;
 
     int width = curr.width * 0.5;
     int height = curr.height;
@@ -267,7 +289,13 @@ public:
   Defaultmarkbelowmark(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis& curr = _y.glyphs[glyphName];
+    GlyphVis* glyph = getGlyph(_y, glyphName);
+
+    if (glyph == nullptr) {
+      return adjust;
+    }
+
+    GlyphVis& curr = *glyph;
 
 
     int width = curr.width * 0.5;
@@ -290,7 +318,13 @@ public:
   Defaulwaqftmarkabovemark(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis& curr = _y.glyphs[glyphName];
+    GlyphVis* glyph = getGlyph(_y, glyphName);
+
+    if (glyph == nullptr) {
+      return adjust;
+    }
+
+    GlyphVis& curr = *glyph;
 
     int width = curr.width * 0.5;
     int height = curr.height + 100;
@@ -325,7 +359,11 @@ public:
       int stop = 5;
     }
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
@@ -343,9 +381,9 @@ public:
     // QPoint adjustoriginal = getAdjustment(_y, _subtable, curr, className, adjust, lefttatweel, righttatweel, &originalglyph);
 
     //if (curr->name == "alternatechar" || curr->name.contains(".added_")) {
-    if (curr->expanded) {
-      originalglyph = &_y.glyphs[curr->originalglyph];
-      adjustoriginal = _subtable.classes[className].baseparameters[curr->originalglyph];
+    if (curr->expanded && getGlyph(_y, curr->originalglyph) != nullptr) {
+      originalglyph = getGlyph(_y, curr->originalglyph);
+      adjustoriginal = getBaseParameter(_subtable, className, curr->originalglyph);
       if (curr->leftAnchor) {
         double xshift = curr->matrix.xpart - originalglyph->matrix.xpart;
         double yshift = curr->matrix.ypart - originalglyph->matrix.ypart;
@@ -408,7 +446,11 @@ public:
   Defaulbaseanchorfortopdots(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -454,7 +496,11 @@ public:
   Defaulbaseanchorforlowdots(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis* curr = &_y.glyphs[glyphName];
+    GlyphVis* curr = getGlyph(_y, glyphName);
+
+    if (curr == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -523,7 +569,11 @@ public:
   Joinedsmalllettersbaseanchor(Automedina& y, MarkBaseSubtable& subtable) : _y(y), _subtable(subtable) {}
   QPoint operator()(QString glyphName, QString className, QPoint adjust, double lefttatweel = 0.0, double righttatweel = 0.0) override {
 
-    GlyphVis* originalglyph = &_y.glyphs[glyphName];
+    GlyphVis* originalglyph = getGlyph(_y, glyphName);
+
+    if (originalglyph == nullptr) {
+      return adjust;
+    }
 
     if (lefttatweel != 0.0 || righttatweel != 0.0) {
       GlyphParameters parameters{};
@@ -942,14 +942,7 @@ mp_edge_object* Glyph::getEdge(bool resetExpParams)
     edge = NULL;
     return edge;
   }
-  mp_edge_object* p = _mp_results->edges;
-  while (p) {
-    if (p->charcode == charcode()) {
-      edge = p;
-      break;
-    }
-    p = p->next;
-  }
+  edge = mp_find_edge_by_code(mp, charcode());
 
   //int res = mp_svg_gr_ship_out(edge, 0, false);
 
@@ -25,10 +25,12 @@
 #include "qregularexpression.h"
 #include "GlyphVis.h"
 #include "automedina/automedina.h"
+#include "AlternateCache.h"
 //#include "qfile.h"
 #include "qjsondocument.h"
 #include "qjsonobject.h"
 #include <unordered_map>
+#include <list>
 #include <fstream>
 #include <math.h>
 
@@ -53,9 +55,22 @@ public:
 		int status = initilizeMetapost();
 
 		if (status == 0) {
-			status = executeMetapost("input medinafont.mp;");
+			// The edges file gives the shipped glyphs only, the macros and the symbol table are not in it, so the
+			// font sources still run, before the first MetaPost statement (a new alternate, nuqta when the first page
+			// is justified). Shaping a page always reaches it : this does not shorten the time to the first page.
+			bool restored = loadShippedEdges("medinafont.edges", "input medinafont.mp;");
+
+			if (!restored) {
+				status = executeMetapost("input medinafont.mp;");
+			}
 
 			layout = new OtLayout(mp, true);
+			// the pages are drawn with displayGlyph after shapePage
+			layout->batchAlternates = true;
+
+			if (!restored && status == 0) {
+				saveShippedEdges("medinafont.edges");
+			}
 
 			loadLookupFile("lookups.json");
 		}
@@ -111,8 +126,25 @@ public:
 	}
 
 
+	bool loadShippedEdges(std::string fileName, std::string fontSource) {
+		QByteArray key = AlternateCache::sourceHash(".");
+		if (!mp_load_shipped_edges(mp, fileName.c_str(), key.constData(), key.size())) {
+			return false;
+		}
+		mp_set_deferred_input(mp, fontSource.c_str());
+		std::cout << "Glyphs loaded from " << fileName << '\n';
+		return true;
+	}
+
+	bool saveShippedEdges(std::string fileName) {
+		QByteArray key = AlternateCache::sourceHash(".");
+		return mp_save_shipped_edges(mp, fileName.c_str(), key.constData(), key.size());
+	}
+
 	void initLayout() {
 		layout = new OtLayout(mp, true);
+		layout->batchAlternates = true;
+		clearPageCache();
 	}
 
 	void initLookup(std::string fileName) {
@@ -162,24 +194,12 @@ public:
 		if (!mp) {
 			std::cout << "cannot initilize mp";
 		}
-		mp_run_data* run = mp_rundata(mp);
-
-		mp_edge_object* p = run->edges;
+		auto glyph = layout->glyphs.find(QString::fromStdString(glyphName));
 
-		while (p != NULL) {
-			if (p->charname == glyphName) {
-				mp_graphic_object* body = p->body;
-
-				if (body) {
-					edgetoHTML5Path(body, ctx);
-				}
-
-				return;
-			}
-			else {
-				p = p->next;
-			}
+		if (glyph != layout->glyphs.end()) {
+			edgetoHTML5Path(*glyph->outline(), ctx);
 
+			return;
 		}
 
 		std::cout << "no char";
@@ -207,7 +227,17 @@ public:
 
 		lineWidth = lineWidth / scale;
 
-		auto page = layout->justifyPage(fontScale, lineWidth, lineWidth, lines, justification, true, tajweedColor);
+		std::string key = "text:" + std::to_string(lineWidth) + ":" + std::to_string(fontScale) + ":" + std::to_string(applyJustification) + ":" + std::to_string(tajweedColor) + ":" + text;
+
+		QList<LineLayoutInfo> page;
+
+		if (auto cached = findCachedPage(key)) {
+			page = cached->page;
+		}
+		else {
+			page = layout->justifyPage(fontScale, lineWidth, lineWidth, lines, justification, true, tajweedColor);
+			insertCachedPage(key, { page, QStringList{} });
+		}
 
 		int currentyPos = 0;
 		int margin = 0;
@@ -269,7 +299,9 @@ public:
 
 		}
 
-		clearAlternates();
+		if (alternatesBudget == 0) {
+			clearAlternates();
+		}
 
 		return -maxWidth * scale;
 
@@ -278,10 +310,14 @@ public:
 #endif
 	PageResult  shapePage(int pageNumber, float fontScalePerc, bool applyJustification, int lineIndex, bool texFormat, bool tajweedColor) {
 
-		//if (cachedPages.find(pageNumber) != cachedPages.end()) {
-		//	std::cout << "Cached page number " << pageNumber << "\n";
-		//	return cachedPages.at(pageNumber);
-		//}
+		int fontScale = (1 << OtLayout::SCALEBY) * fontScalePerc;
+
+		std::string key = "page:" + std::to_string(pageNumber) + ":" + std::to_string(lineIndex) + ":" + std::to_string(fontScale)
+			+ ":" + std::to_string(applyJustification) + ":" + std::to_string(texFormat) + ":" + std::to_string(tajweedColor);
+
+		if (auto cached = findCachedPage(key)) {
+			return *cached;
+		}
 
 		int lineWidth = pageWidth;
 
@@ -322,8 +358,6 @@ public:
 
 		}
 
-		int fontScale = (1 << OtLayout::SCALEBY) * fontScalePerc;
-
 		if (lineIndex >= 0) {
 			lines = QStringList{ lines[lineIndex] };
 		}
@@ -429,11 +463,11 @@ public:
 
 		}
 
-		//cachedPages.insert({ pageNumber, page });
-		//PageResult resutl;
-		//resutl.page = page;
+		PageResult result{ page, lines };
 
-		return { page, lines };
+		insertCachedPage(key, result);
+
+		return result;
 
 	}
 #if defined DIGITALKHATT_WEBLIB && defined  EMSCRIPTEN
@@ -451,8 +485,27 @@ public:
 		layout->clearAlternates();
 	}
 
+	// The shaped pages and texts are kept up to the budget and evicted in LRU order, 0 disables the cache
+	void setPageCacheBudget(int bytes) {
+		pageCacheBudget = bytes;
+		trimCachedPages();
+	}
+
+	void clearPageCache() {
+		cachedPages.clear();
+		cachedPagesOrder.clear();
+		pageCacheSize = 0;
+	}
+
+	// With a budget the justification alternates are kept between calls and evicted in LRU order
+	void setAlternatesBudget(int bytes) {
+		alternatesBudget = bytes;
+		layout->setAlternatesBudget(bytes);
+	}
+
 	MP mp;
 	OtLayout* layout;
+	int alternatesBudget = 0;
 
 private:
 
@@ -481,7 +534,55 @@ private:
 
 	int pageWidth = (17000 - (2 * 400)) << OtLayout::SCALEBY;
 
-	std::unordered_map<int, QList<LineLayoutInfo>> cachedPages;
+	struct CachedPage {
+		PageResult result;
+		int size;
+		std::list<std::string>::iterator order;
+	};
+
+	std::unordered_map<std::string, CachedPage> cachedPages;
+	// most recently used first
+	std::list<std::string> cachedPagesOrder;
+	int pageCacheSize = 0;
+	int pageCacheBudget = 32 << 20;
+
+	PageResult* findCachedPage(const std::string& key) {
+		auto find = cachedPages.find(key);
+		if (find == cachedPages.end()) {
+			return nullptr;
+		}
+
+		cachedPagesOrder.splice(cachedPagesOrder.begin(), cachedPagesOrder, find->second.order);
+
+		return &find->second.result;
+	}
+
+	void insertCachedPage(const std::string& key, const PageResult& result) {
+		if (pageCacheBudget <= 0) return;
+
+		int size = key.size() + sizeof(CachedPage);
+		for (auto& line : result.page) {
+			size += sizeof(LineLayoutInfo) + line.glyphs.size() * sizeof(GlyphLayoutInfo);
+		}
+		for (auto& line : result.originalPage) {
+			size += line.size() * sizeof(QChar);
+		}
+
+		cachedPagesOrder.push_front(key);
+		cachedPages[key] = { result, size, cachedPagesOrder.begin() };
+		pageCacheSize += size;
+
+		trimCachedPages();
+	}
+
+	void trimCachedPages() {
+		while (pageCacheSize > pageCacheBudget && !cachedPagesOrder.empty()) {
+			auto find = cachedPages.find(cachedPagesOrder.back());
+			pageCacheSize -= find->second.size;
+			cachedPages.erase(find);
+			cachedPagesOrder.pop_back();
+		}
+	}
 
 	void readTexPages() {
 		double size;
@@ -525,140 +626,99 @@ private:
 			std::cout << "cannot initilize mp";
 			return "error";
 		}
-		mp_run_data* run = mp_rundata(mp);
-
-		mp_edge_object* p = run->edges;
-
-		while (p != NULL) {
-			if (p->charname == glyphName) {
-				std::stringstream ret;
-				ret << "function(ctx) {\n";
-				mp_graphic_object* body = p->body;
+		auto glyph = layout->glyphs.find(QString::fromStdString(glyphName));
 
-				if (body) {
-
-					ret << "\tctx.beginPath();\n";
-					do {
-						switch (body->type)
-						{
-						case mp_fill_code: {
-							filltoHTML5Path(((mp_fill_object*)body)->path_p, ret);
-
-							break;
-						}
-						default:
-							break;
-						}
+		if (glyph != layout->glyphs.end()) {
+			std::stringstream ret;
+			ret << "function(ctx) {\n";
+			auto outline = glyph->outline();
 
-					} while (body = body->next);
+			if (!outline->contours.empty()) {
 
-					ret << "\tctx.fill();\n";
+				ret << "\tctx.beginPath();\n";
+				for (auto& contour : outline->contours) {
+					filltoHTML5Path(*outline, contour, ret);
 				}
-				ret << "}";
-				return ret.str();
-			}
 
-			p = p->next;
+				ret << "\tctx.fill();\n";
+			}
+			ret << "}";
+			return ret.str();
 		}
 
 		std::cout << "no char";
 		return "error";
 	}
 
-	void filltoHTML5Path(mp_gr_knot h, std::stringstream& out)
+	void filltoHTML5Path(const GlyphOutline& outline, const GlyphOutline::Contour& contour, std::stringstream& out)
 	{
-		mp_gr_knot p, q;
+		if (contour.size == 0) return;
+
+		int p, q;
+		int first = contour.first;
 
-		out << "\tctx.moveTo(" << h->x_coord << "," << h->y_coord << ");\n";
-		p = h;
+		out << "\tctx.moveTo(" << outline.x[first] << "," << outline.y[first] << ");\n";
+		p = first;
 		do {
-			q = p->next;
-			out << "\tctx.bezierCurveTo(" << p->right_x << "," << p->right_y << "," << q->left_x << "," << q->left_y << "," << q->x_coord << "," << q->y_coord << ");\n";
+			q = outline.next(contour, p);
+			out << "\tctx.bezierCurveTo(" << outline.rightX[p] << "," << outline.rightY[p] << "," << outline.leftX[q] << "," << outline.leftY[q] << "," << outline.x[q] << "," << outline.y[q] << ");\n";
 
 			p = q;
-		} while (p != h);
-		if (h->data.types.left_type != mp_endpoint)
+		} while (p != first);
+		if (contour.closed)
 			out << "\tctx.closePath()\n";
 
 
 	}
 
-	void filltoHTML5Path(mp_gr_knot h, emscripten::val ctx)
+	void filltoHTML5Path(const GlyphOutline& outline, const GlyphOutline::Contour& contour, emscripten::val ctx)
 	{
-		mp_gr_knot p, q;
+		if (contour.size == 0) return;
 
-		ctx.call<void>("moveTo", h->x_coord, h->y_coord);
+		int p, q;
+		int first = contour.first;
 
-		p = h;
+		ctx.call<void>("moveTo", outline.x[first], outline.y[first]);
+
+		p = first;
 		do {
-			q = p->next;
+			q = outline.next(contour, p);
 
-			ctx.call<void>("bezierCurveTo", p->right_x, p->right_y, q->left_x, q->left_y, q->x_coord, q->y_coord);
+			ctx.call<void>("bezierCurveTo", outline.rightX[p], outline.rightY[p], outline.leftX[q], outline.leftY[q], outline.x[q], outline.y[q]);
 
 			p = q;
-		} while (p != h);
-		if (h->data.types.left_type != mp_endpoint) {
+		} while (p != first);
+		if (contour.closed) {
 			ctx.call<void>("closePath");
 		}
 
 	}
 
 	void getImageStream(GlyphVis& glyph, emscripten::val ctx) {
-		auto edge = glyph.edge();
-
-		if (edge != nullptr) {
-			mp_graphic_object* body = edge->body;
-			if (body) {
-				do {
-					switch (body->type)
-					{
-					case mp_fill_code: {
-						auto fillobject = (mp_fill_object*)body;
-						ctx.call<void>("beginPath");
-
-						filltoHTML5Path(fillobject->path_p, ctx);
-						if (fillobject->color_model == mp_rgb_model) {
-							ctx.set("fillStyle", emscripten::val("rgb(" + std::to_string(fillobject->color.a_val * 255) + "," + std::to_string(fillobject->color.b_val * 255) + "," + std::to_string(fillobject->color.c_val * 255) + ")"));
-							//out << "\tctx.fillStyle = 'rgb(" << fillobject->color.a_val * 255 << "," << fillobject->color.b_val * 255 << "," << fillobject->color.c_val * 255 << ")';\n";
-
-						}
-						//out << "\tctx.fill();\n";
-						ctx.call<void>("fill");
-						ctx.set("fillStyle", emscripten::val("rgb(0,0,0)"));
-						//out << "\tctx.fillStyle = 'rgb(0,0,0)';\n";
+		auto outline = glyph.outline();
 
-						break;
-					}
-					default:
-						break;
-					}
+		for (auto& contour : outline->contours) {
+			ctx.call<void>("beginPath");
 
-				} while (body = body->next);
+			filltoHTML5Path(*outline, contour, ctx);
+			if (contour.hasColor) {
+				ctx.set("fillStyle", emscripten::val("rgb(" + std::to_string(contour.red * 255) + "," + std::to_string(contour.green * 255) + "," + std::to_string(contour.blue * 255) + ")"));
 			}
+			ctx.call<void>("fill");
+			ctx.set("fillStyle", emscripten::val("rgb(0,0,0)"));
 		}
 
 	}
 
-	void edgetoHTML5Path(mp_graphic_object* body, emscripten::val ctx)
+	void edgetoHTML5Path(const GlyphOutline& outline, emscripten::val ctx)
 	{
 
-		if (body) {
+		if (!outline.contours.empty()) {
 
 			ctx.call<void>("beginPath");
-			do {
-				switch (body->type)
-				{
-				case mp_fill_code: {
-					filltoHTML5Path(((mp_fill_object*)body)->path_p, ctx);
-
-
-					break;
-				}
-				default:
-					break;
-				}
-
-			} while (body = body->next);
+			for (auto& contour : outline.contours) {
+				filltoHTML5Path(outline, contour, ctx);
+			}
 
 			ctx.call<void>("fill");
 		}
@@ -750,7 +810,7 @@ private:
 			ctx.call<void>("restore");
 		}
 		else {
-			edgetoHTML5Path(glyph.copiedPath, ctx);
+			edgetoHTML5Path(*glyph.outline(), ctx);
 		}
 
 	}
@@ -777,6 +837,7 @@ private:
 			else {
 				QJsonDocument mDocument = QJsonDocument::fromJson(QByteArray::fromRawData(buffer, length));
 				layout->readJson(mDocument.object());
+				clearPageCache();
 
 			}
 
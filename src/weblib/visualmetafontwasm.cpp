@@ -183,6 +183,9 @@ EMSCRIPTEN_BINDINGS(my_module) {
 		.function("shapePage", &QuranShaper::shapePage)
 		.function("displayGlyph", &QuranShaper::displayGlyph)
 		.function("clearAlternates", &QuranShaper::clearAlternates)
+		.function("setAlternatesBudget", &QuranShaper::setAlternatesBudget)
+		.function("setPageCacheBudget", &QuranShaper::setPageCacheBudget)
+		.function("clearPageCache", &QuranShaper::clearPageCache)
 		.function("getGlyphName", &QuranShaper::getGlyphName)
 		.function("getGlyphCode", &QuranShaper::getGlyphCode)		
 		.function("drawPathByName", &QuranShaper::drawPath)